@@ -23,6 +23,8 @@
 #define AC101_H
 
 #include <inttypes.h>
+#include <stddef.h>
+#include "AC101Bus.h"
 
 class AC101
 {
@@ -93,8 +95,21 @@ public:
 		MODE_LINE
 	} Mode_t;
 
+	// Bus transaction counters, see GetStats() and GetInitStats().
+	typedef struct {
+		uint32_t transactions;	// I2C transfers issued
+		uint32_t reads;			// Registers read from the chip
+		uint32_t writes;		// Registers written to the chip
+		uint32_t cached;		// Reads served from the shadow registers
+		uint32_t skipped;		// Writes dropped, chip already holds the value
+		uint32_t coalesced;		// Writes merged with a later write in a batch
+		uint32_t delayMs;		// Time spent waiting for the codec
+		uint32_t micros;		// Wall time, only filled in for the init stats
+	} Stats_t;
+
 	// Constructor.
-  	AC101();
+	// @param bus   Register transport, NULL selects the Wire bus.
+  	AC101(AC101Bus *bus = NULL);
 
 	// Initialize codec, using provided I2C pins and bus frequency.
 	// @return True on success, false on failure.
@@ -153,10 +168,53 @@ public:
 
 	// Dumpt the current register configuration to serial.
 	void DumpRegisters();
-	
+
+	// Collect register writes in the shadow registers instead of sending them.
+	// Batches nest, the outermost EndBatch() sends the collected writes.
+	void BeginBatch();
+
+	// Close a batch, on the outermost level all changed registers are written,
+	// in ascending register order, consecutive registers in one transfer.
+	// @return True on success, false on failure.
+	bool EndBatch();
+
+	// Send the writes collected so far, without closing the batch.
+	// Use where the codec needs a sequence of writes or a delay.
+	// @return True on success, false on failure.
+	bool Flush();
+
+	// Maximum nr of consecutive registers sent in one transfer.
+	// Default 1, only raise this when the codec auto increments the register address.
+	void SetMaxBurst(uint8_t registers);
+
+	// @return Bus counters since construction.
+	const Stats_t &GetStats() const { return stats; }
+
+	// @return Bus counters and duration of the last begin().
+	const Stats_t &GetInitStats() const { return initStats; }
+
 protected:
 	bool WriteReg(uint8_t reg, uint16_t val);
 	uint16_t ReadReg(uint8_t reg);
+
+	// Read the register from the chip, bypassing the shadow registers.
+	uint16_t ReadRegUncached(uint8_t reg);
+
+	void Delay(uint32_t ms);
+
+private:
+	// Shadow copy of the codec registers, valid and dirty bit per register.
+	uint16_t shadow[256];
+	uint32_t valid[256 / 32];
+	uint32_t dirty[256 / 32];
+	int batchDepth;
+	uint8_t maxBurst;
+
+	AC101Bus *bus;
+	Stats_t stats;
+	Stats_t initStats;
+
+	void Invalidate();
 };
 
 #endif
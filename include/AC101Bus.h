@@ -0,0 +1,67 @@
+/*
+	AC101 - An AC101 Codec driver library for Arduino
+	Copyright (C) 2019, Ivo Pullens, Emmission
+
+	Inspired by:
+	https://github.com/donny681/esp-adf/tree/master/components/audio_hal/driver/AC101
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AC101BUS_H
+#define AC101BUS_H
+
+#include <inttypes.h>
+
+// Transport used by the AC101 driver to reach the codec registers.
+// The Arduino build talks to the chip through Wire, host builds can plug in
+// AC101MockBus to run the driver without hardware.
+class AC101Bus
+{
+public:
+	virtual ~AC101Bus() {}
+
+	// Initialize the bus, using provided I2C pins and bus frequency.
+	// @return True on success, false on failure.
+	virtual bool Begin(int sda, int scl, uint32_t frequency) = 0;
+
+	// Write count consecutive 16 bit registers, starting at reg, in one transaction.
+	// @return True on success, false on failure.
+	virtual bool Write(uint8_t addr, uint8_t reg, const uint16_t *vals, uint8_t count) = 0;
+
+	// Read one 16 bit register.
+	// @return True on success, false on failure.
+	virtual bool Read(uint8_t addr, uint8_t reg, uint16_t *val) = 0;
+
+	// Wait for the codec, e.g. after a reset or while an output stage ramps up.
+	virtual void DelayMs(uint32_t ms) = 0;
+
+	// Free running microsecond clock, used for the init cost report.
+	virtual uint32_t Micros() = 0;
+};
+
+#ifdef ARDUINO
+// Default bus, talks to the codec through the Arduino Wire library.
+class AC101WireBus : public AC101Bus
+{
+public:
+	bool Begin(int sda, int scl, uint32_t frequency);
+	bool Write(uint8_t addr, uint8_t reg, const uint16_t *vals, uint8_t count);
+	bool Read(uint8_t addr, uint8_t reg, uint16_t *val);
+	void DelayMs(uint32_t ms);
+	uint32_t Micros();
+};
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+	AC101 - An AC101 Codec driver library for Arduino
+	Copyright (C) 2019, Ivo Pullens, Emmission
+
+	Inspired by:
+	https://github.com/donny681/esp-adf/tree/master/components/audio_hal/driver/AC101
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef AC101MOCKBUS_H
+#define AC101MOCKBUS_H
+
+#include <string.h>
+#include "AC101Bus.h"
+
+// In-memory stand-in for the codec, so the driver runs on a Linux host.
+// Keeps a register file, counts every bus transaction and advances a
+// virtual clock by the time the transfer would take on a real I2C bus.
+class AC101MockBus : public AC101Bus
+{
+public:
+	AC101MockBus()
+	{
+		Reset();
+	}
+
+	// Forget register contents and counters.
+	void Reset()
+	{
+		memset(registers, 0, sizeof(registers));
+		transactions = 0;
+		registerWrites = 0;
+		registerReads = 0;
+		nowMicros = 0;
+		frequency = 400000;
+		for (int i = 0; i < 256; ++i)
+			writeCount[i] = 0;
+	}
+
+	bool Begin(int sda, int scl, uint32_t freq)
+	{
+		frequency = freq ? freq : 400000;
+		return true;
+	}
+
+	bool Write(uint8_t addr, uint8_t reg, const uint16_t *vals, uint8_t count)
+	{
+		transactions++;
+		// start + address + register + 2 bytes per value, 9 clocks per byte
+		Advance(2 + count * 2);
+		for (uint8_t i = 0; i < count; ++i)
+		{
+			uint8_t r = uint8_t(reg + i);
+			registerWrites++;
+			writeCount[r]++;
+			// Writing 0x123 to the reset register resets the chip
+			if ((r == 0x00) and (vals[i] == 0x123))
+			{
+				memset(registers, 0, sizeof(registers));
+				registers[0x00] = 0x0101;
+			}
+			else
+			{
+				registers[r] = vals[i];
+			}
+		}
+		return true;
+	}
+
+	bool Read(uint8_t addr, uint8_t reg, uint16_t *val)
+	{
+		transactions++;
+		registerReads++;
+		// write of register address followed by a repeated start and 2 bytes
+		Advance(5);
+		*val = registers[reg];
+		return true;
+	}
+
+	void DelayMs(uint32_t ms)
+	{
+		nowMicros += ms * 1000;
+	}
+
+	uint32_t Micros()
+	{
+		return nowMicros;
+	}
+
+	uint16_t registers[256];
+	uint16_t writeCount[256];
+	uint32_t transactions;
+	uint32_t registerWrites;
+	uint32_t registerReads;
+
+private:
+	void Advance(uint32_t bytes)
+	{
+		nowMicros += (bytes * 9 * 1000000UL) / frequency;
+	}
+
+	uint32_t nowMicros;
+	uint32_t frequency;
+};
+
+#endif
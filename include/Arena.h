@@ -0,0 +1,85 @@
+/*!
+ *  @file       Arena.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Memory taken from the heap once, handed out in pieces that are never freed.
+ *
+ * Taken from the heap in begin(), so buffers that live as long as the
+ * synthesizer do not fragment the heap and the memory use is known up front.
+ * The internal RAM of the ESP32 is split in regions and its largest free
+ * block is far smaller than the free heap, so the arena is made of chunks
+ * of at most the largest free block. A piece never spans two chunks, the
+ * room it leaves at the end of a chunk is taken from the heap again when
+ * the last chunk runs out, so the size still counts the bytes handed out.
+ * A part that fails halfway can give its pieces back with release(), the
+ * peak keeps the most that was ever in use.
+ */
+class Arena
+{
+public:
+    static const size_t ALIGNMENT = 4; // default alignment of the pieces
+    static const int MAXCHUNKS = 16;
+
+    Arena() = default;
+    ~Arena();
+    Arena(const Arena &) = delete; // a copy would free the block twice
+    Arena &operator=(const Arena &) = delete;
+    bool begin(size_t size);
+    void *allocate(size_t bytes, size_t alignment = ALIGNMENT);
+    void release(size_t mark);
+    size_t getSize() const;
+    size_t getUsed() const { return used; }
+    size_t getPeak() const { return peak; }
+    int getNrOfChunks() const { return nrOfChunks; }
+
+    static size_t getLargestFreeBlock();
+
+private:
+    struct Chunk {
+        uint8_t *toMemory;
+        size_t size;
+        size_t end; // bytes handed out, padding included
+    };
+
+    bool addChunk(size_t bytes);
+    void freeChunks();
+
+    Chunk chunks[MAXCHUNKS] = {};
+    int nrOfChunks = 0;
+    int current = 0;   // chunk the last piece came from
+    size_t size = 0;   // bytes asked for in begin()
+    size_t used = 0;   // bytes handed out, padding included
+    size_t peak = 0;
+};
+
+// -----------------------------------------------------------------------------
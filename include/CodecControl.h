@@ -0,0 +1,83 @@
+/*!
+ *  @file       CodecControl.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include "AC101.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Queue of codec commands, executed by a low priority worker task.
+ *
+ * Posting a command never touches the I2C bus, so it is safe from the MIDI
+ * callbacks and the audio loop. A command that is still pending is replaced
+ * by a newer one of the same kind, only the last volume is sent to the codec.
+ * When the worker task cannot be started the owner calls service() itself.
+ */
+class CodecControl
+{
+public:
+    static const int SETVOLUMEHEADPHONE = 0;
+    static const int SETVOLUMESPEAKER   = 1;
+    static const int NROFCOMMANDS       = 2;
+
+    struct Stats {
+        uint32_t posted;       // commands posted
+        uint32_t coalesced;    // commands replaced by a later one before execution
+        uint32_t executed;     // commands sent to the codec
+        uint32_t failed;       // commands the codec did not acknowledge
+        uint32_t maxLatency;   // micros from first post to execution
+        uint32_t totalLatency; // sum, for the average
+    };
+
+    void begin(AC101 *toCodec);
+    void post(int command, uint8_t value);
+    int service();
+    bool hasWorker() const { return toWorker != NULL; }
+    const Stats &getStats() const { return stats; }
+    void printStats();
+
+private:
+    static void workerTask(void *toCodecControl);
+
+    struct Slot {
+        bool pending;
+        uint8_t value;
+        uint32_t postTime;
+    };
+
+    AC101 *toCodec = NULL;
+    void *toWorker = NULL;
+    Slot slots[NROFCOMMANDS];
+    Stats stats = {};
+
+    bool execute(int command, uint8_t value);
+};
+
+// -----------------------------------------------------------------------------
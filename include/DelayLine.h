@@ -0,0 +1,95 @@
+/*!
+ *  @file       DelayLine.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "Arena.h"
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Ring buffer of past samples with an interpolated read.
+ *
+ * The memory comes from an Arena. With COMPACTDELAYLINES the samples are
+ * stored in 16 bits, saturated, which halves the RAM of the effects.
+ */
+class DelayLine
+{
+public:
+    bool begin(Arena *toArena, int length);
+    void clear();
+    int getLength() const { return length; }
+
+    inline void write(int32_t sample) {
+      if (COMPACTDELAYLINES) {
+        if (sample > 0x7fff)
+          sample = 0x7fff;
+        else if (sample < -0x8000)
+          sample = -0x8000;
+        toSamples16[writeIndex] = (int16_t) sample;
+      } else {
+        toSamples32[writeIndex] = sample;
+      }
+      writeIndex++;
+      if (writeIndex >= length)
+        writeIndex = 0;
+    }
+
+    // Sample written delay samples ago, delay is below length.
+    // Read before write, a delay of 0 is the last written sample.
+    inline int32_t tap(int delay) const {
+      int index = writeIndex - 1 - delay;
+      if (index < 0)
+        index += length;
+      return sampleAt(index);
+    }
+
+    // Sample written delay samples ago, delay is Q16 and below length - 1.
+    // Read before write, a delay of 0 is the last written sample.
+    inline int32_t read(int32_t delay) const {
+      int index = writeIndex - 1 - (delay >> 16);
+      if (index < 0)
+        index += length;
+      int before = (index == 0) ? (length - 1) : (index - 1);
+      int32_t newer = sampleAt(index);
+      int32_t older = sampleAt(before);
+      return newer + (int32_t) (((int64_t) (older - newer) * (delay & 0xffff)) >> 16);
+    }
+
+private:
+    int16_t *toSamples16 = NULL;
+    int32_t *toSamples32 = NULL;
+    int length = 0;
+    int writeIndex = 0;
+
+    inline int32_t sampleAt(int index) const {
+      return COMPACTDELAYLINES ? toSamples16[index] : toSamples32[index];
+    }
+};
+
+// -----------------------------------------------------------------------------
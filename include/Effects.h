@@ -0,0 +1,106 @@
+/*!
+ *  @file       Effects.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Arena.h"
+#include "DelayLine.h"
+#include "Reverb.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Effects bus after the voice mix: stereo chorus, a tempo synced delay and reverb.
+ *
+ * The effects run at the sample rate divided down to about 48 kHz, the mix
+ * is averaged into them and their output is interpolated back up, so the
+ * delay lines and the CPU cost do not grow with the output sample rate.
+ * Parameters are 0..127 values, set per parameter number as from SysEx.
+ */
+class Effects
+{
+public:
+    static const uint8_t CHORUSLEVEL   = 0;
+    static const uint8_t CHORUSRATE    = 1; // 0.1..5 Hz
+    static const uint8_t CHORUSDEPTH   = 2; // 0..CHORUSDEPTHMS
+    static const uint8_t DELAYLEVEL    = 3;
+    static const uint8_t DELAYFEEDBACK = 4;
+    static const uint8_t DELAYNOTE     = 5; // index in the note value table
+    static const uint8_t TEMPO         = 6; // beats per minute / 2
+    static const uint8_t REVERBLEVEL   = 7;
+    static const uint8_t REVERBTIME    = 8; // 0.2..8 seconds
+    static const uint8_t REVERBDAMPING = 9;
+    static const uint8_t NROFPARAMETERS = 10;
+
+    static size_t arenaBytes(int sampleRate);
+    bool begin(Arena *toArena, int sampleRate);
+    void setParameter(uint8_t parameter, uint8_t value);
+    void setBeatMicros(uint32_t micros);
+    bool isActive() const { return !bypassed && hasSends(); }
+    void setBypass(bool on);
+    void setCheapInterpolation(bool on) { cheapInterpolation = on; }
+    void process(int32_t left[], int32_t right[], int bufferSize);
+
+private:
+    int decimationShift = 0; // effects rate is the sample rate >> decimationShift
+    int effectsRate = 0;
+    DelayLine chorusLine;
+    DelayLine delayLine;
+    Reverb reverb;
+    bool cleared = true;     // delay lines hold no old signal
+    bool bypassed = false;   // switched off to save CPU time, the levels are kept
+    bool cheapInterpolation = false; // nearest sample delay reads, output held instead of interpolated
+
+    int32_t chorusLevel = 0;   // Q15
+    float chorusRateHz = 0.5;
+    float chorusPhase = 0.0;   // radians
+    int32_t chorusDepth = 0;   // Q16 samples
+    int32_t chorusLeft = 0;    // delay of the left tap, Q16 samples
+    int32_t chorusRight = 0;
+
+    int32_t delayLevel = 0;    // Q15
+    int32_t delayFeedback = 0; // Q15
+    uint8_t delayNote = 2;
+    uint32_t beatMicros = 500000; // 120 bpm until set
+    int32_t delayTime = 0;     // Q16 samples
+    int32_t delayTarget = 0;
+
+    int32_t reverbLevel = 0;   // Q15
+
+    int32_t lastWetLeft = 0;
+    int32_t lastWetRight = 0;
+
+    bool hasSends() const { return (chorusLevel > 0) || (delayLevel > 0) || (reverbLevel > 0); }
+    void clear();
+    static int effectsShift(int sampleRate);
+    static int chorusLength(int rate);
+    static int delayLength(int rate);
+    void updateDelayTarget();
+};
+
+// -----------------------------------------------------------------------------
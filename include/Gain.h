@@ -0,0 +1,98 @@
+/*!
+ *  @file       Gain.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+static const int32_t UNITYGAIN = 0x8000; // gains are Q15, 0x8000 = 1.0
+
+/*! \brief Gain that ramps linearly to its target over one block.
+ *
+ * The ramp runs in Q23 so small changes still move every sample, which
+ * keeps volume automation free of zipper noise.
+ */
+class SmoothedGain
+{
+public:
+    // Jump to a gain, no ramp
+    inline void set(int32_t gain) {
+      current = gain << 8;
+      target = current;
+      step = 0;
+    }
+    // Ramp to a gain during the next block
+    inline void setTarget(int32_t gain) {
+      target = gain << 8;
+    }
+    inline int32_t getTarget() const {
+      return target >> 8;
+    }
+    // Call before the samples of a block
+    inline void beginBlock(int blockSize) {
+      step = (target - current) / blockSize;
+    }
+    // Gain for the next sample in Q15
+    inline int32_t next() {
+      current += step;
+      return current >> 8;
+    }
+    // Call after the samples of a block, removes the rounding left by the step
+    inline void endBlock() {
+      current = target;
+      step = 0;
+    }
+    inline bool isRamping() const {
+      return current != target;
+    }
+
+private:
+    int32_t current = UNITYGAIN << 8;
+    int32_t target = UNITYGAIN << 8;
+    int32_t step = 0;
+};
+
+// Maps a MIDI controller value 0..127 on a squared curve to a Q15 gain
+static inline int32_t controllerToGain(uint8_t value) {
+    if (value > 127)
+      value = 127;
+    return ((int32_t) value * value * UNITYGAIN) / (127 * 127);
+}
+
+// Clamps a sample to the 16 bit output range
+static inline int32_t saturate16(int32_t sample) {
+    if (sample > 0x7fff)
+      return 0x7fff;
+    if (sample < -0x8000)
+      return -0x8000;
+    return sample;
+}
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,80 @@
+/*!
+ *  @file       Governor.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Trades sound quality for CPU time before the audio drops out.
+ *
+ * Fed with the render time of every block. When the smoothed load goes
+ * above GOVERNORHIGHPERCENT, or a block misses its deadline, it steps one
+ * level down the list below and waits a few blocks to see the effect.
+ * Once the load stays under GOVERNORLOWPERCENT for a while it steps back
+ * up. The gap between the two thresholds and the longer wait for going
+ * up keep it from toggling on a steady load.
+ */
+class Governor
+{
+public:
+    static const int FULLQUALITY        = 0;
+    static const int CAPPEDPOLYPHONY    = 1; // no new voices above what plays now
+    static const int NOFILTERS          = 2; // per-voice filters bypassed
+    static const int CHEAPINTERPOLATION = 3; // effects read their delay lines without interpolation
+    static const int NOEFFECTS          = 4; // effects bus off
+    static const int NROFLEVELS         = 5;
+
+    struct Stats {
+        uint32_t stepsDown;                // transitions to a lower quality
+        uint32_t stepsUp;
+        uint32_t entered[NROFLEVELS];      // transitions into each level
+        uint32_t blocksAtLevel[NROFLEVELS];
+        uint32_t overruns;                 // blocks that took longer than the block period
+        uint32_t lastChangeBlock;          // block count at the last transition
+        uint32_t blocks;
+    };
+
+    void reset();
+    bool update(uint32_t renderMicros, uint32_t blockMicros);
+    int getLevel() const { return level; }
+    uint32_t getLoad() const { return load >> 8; } // smoothed, percent of the block period
+    const Stats &getStats() const { return stats; }
+    void printStats();
+
+private:
+    int level = FULLQUALITY;
+    uint32_t load = 0;   // percent in Q8
+    int holdBlocks = 0;  // blocks left before the next step down
+    int quietBlocks = 0; // blocks in a row under the low threshold
+    Stats stats = {};
+
+    void changeLevel(int newLevel);
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,80 @@
+/*!
+ *  @file       LatencyTrace.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Latency histograms of the path from a MIDI byte to the DAC.
+ *
+ * A note is timed at four points: the first byte seen by the MIDI parser,
+ * the parsed message, the voice start and the moment its first nonzero
+ * sample leaves the I2S DMA. Each stage between two points has a histogram
+ * with power of two buckets. Builds on a host as well, so simulations
+ * report the same numbers.
+ */
+class LatencyTrace
+{
+public:
+    static const int BYTETOPARSE   = 0; // UART byte seen until message parsed
+    static const int PARSETOVOICE  = 1; // parsed until the voice is started
+    static const int VOICETOOUTPUT = 2; // voice start until its first sample leaves the DMA
+    static const int BYTETOOUTPUT  = 3; // end to end
+    static const int NROFSTAGES    = 4;
+    static const int NROFBUCKETS   = 17; // bucket n holds 2^(n-1)..2^n - 1 us, the last one the rest
+
+    struct Histogram {
+        uint32_t counts[NROFBUCKETS];
+        uint32_t notes;
+        uint32_t maxMicros;
+        uint64_t totalMicros;
+    };
+
+    // Times of one note, 0 for points that were not seen
+    struct Times {
+        uint32_t byteMicros;
+        uint32_t parseMicros;
+        uint32_t voiceMicros;
+        uint32_t outputMicros;
+    };
+
+    void reset();
+    void record(const Times &times);
+    void recordStage(int stage, uint32_t micros);
+    const Histogram &getHistogram(int stage) const { return histograms[stage]; }
+    uint32_t getPercentile(int stage, int percent) const;
+    int format(int stage, char *text, int size) const;
+
+    static const char *getStageName(int stage);
+
+private:
+    Histogram histograms[NROFSTAGES] = {};
+};
+
+// -----------------------------------------------------------------------------
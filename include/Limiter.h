@@ -0,0 +1,66 @@
+/*!
+ *  @file       Limiter.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Look ahead limiter on the master bus, makes the output samples.
+ *
+ * The output is one block behind the mix. The gain for a block is known
+ * before it is played, so the gain can ramp down across the block before
+ * it, and no sample goes above the threshold. When the block size changes
+ * the output block has the size of the delayed block, so no samples are
+ * lost or added. Above the threshold the
+ * curve has a soft knee, the gain comes back at the release rate.
+ */
+class Limiter
+{
+public:
+    void begin(int sampleRate);
+    int process(const int32_t left[], const int32_t right[], uint32_t out[], int bufferSize);
+    int32_t getGain() const { return gain; }
+    uint32_t getLimitedBlocks() const { return limitedBlocks; }
+    void printStats();
+
+private:
+    int32_t delayedLeft[BUFFERSIZE] = {};
+    int32_t delayedRight[BUFFERSIZE] = {};
+    int delayedSize = BUFFERSIZE; // samples in the delayed block, silence before the first block
+    int32_t delayedTarget = 0x8000; // Q15 gain the delayed block needs
+    int32_t gain = 0x8000;          // Q15 gain at the end of the last output block
+    int32_t releaseStep = 0;        // Q15 per BUFFERSIZE samples
+    uint32_t limitedBlocks = 0;     // blocks played with a gain below 1
+    int32_t minGain = 0x8000;
+
+    static int32_t targetGain(int32_t peak);
+};
+
+// -----------------------------------------------------------------------------
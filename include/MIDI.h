@@ -151,6 +151,11 @@ public:
     inline Channel getInputChannel() const;
     inline void setInputChannel(Channel inChannel);
 
+public:
+    inline void setTimestampClock(uint32_t (*fptr)(void));
+    inline uint32_t getByteMicros() const;
+    inline uint32_t getParseMicros() const;
+
 public:
     static inline MidiType getTypeFromStatusByte(byte inStatus);
     static inline Channel getChannelFromStatusByte(byte inStatus);
@@ -241,6 +246,10 @@ private:
     bool            mThruActivated  : 1;
     Thru::Mode      mThruFilterMode : 7;
     MidiMessage     mMessage;
+    uint32_t        (*mTimestampClock)(void);
+    uint32_t        mPendingByteMicros;
+    uint32_t        mByteMicros;
+    uint32_t        mParseMicros;
 
 
 private:
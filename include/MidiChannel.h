@@ -0,0 +1,159 @@
+/*!
+ *  @file       MidiChannel.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include "Gain.h"
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Set of MIDI notes 0..127, one bit per note.
+ */
+struct NoteSet
+{
+    uint32_t words[4];
+
+    inline void clearAll() {
+      words[0] = words[1] = words[2] = words[3] = 0;
+    }
+    inline void set(uint8_t note) {
+      words[(note >> 5) & 3] |= (1UL << (note & 31));
+    }
+    inline void clear(uint8_t note) {
+      words[(note >> 5) & 3] &= ~(1UL << (note & 31));
+    }
+    inline bool test(uint8_t note) const {
+      return (words[(note >> 5) & 3] >> (note & 31)) & 1;
+    }
+};
+
+/*! \brief Patch and controller state of one MIDI channel.
+ *
+ * Every channel has its own waveform style, envelope, gain and bend range,
+ * so one synthesizer can play several parts at once. The synthesizer keeps
+ * one MidiChannel per channel number, found by index from the MIDI events.
+ */
+class MidiChannel
+{
+public:
+    static const uint8_t CCMODULATION   = 1;
+    static const uint8_t CCDATAENTRY    = 6;
+    static const uint8_t CCVOLUME       = 7;
+    static const uint8_t CCEXPRESSION   = 11;
+    static const uint8_t CCSUSTAIN      = 64;
+    static const uint8_t CCSOSTENUTO    = 66;
+    static const uint8_t CCRESONANCE    = 71;
+    static const uint8_t CCRELEASETIME  = 72;
+    static const uint8_t CCATTACKTIME   = 73;
+    static const uint8_t CCCUTOFF       = 74;
+    static const uint8_t CCFILTERENVELOPE = 79;
+    static const uint8_t CCFILTERKEYTRACK = 80;
+    static const uint8_t CCDATAENTRYLSB = 38;
+    static const uint8_t CCNRPNLSB      = 98;
+    static const uint8_t CCNRPNMSB      = 99;
+    static const uint8_t CCRPNLSB       = 100;
+    static const uint8_t CCRPNMSB       = 101;
+
+    // Registered parameter numbers
+    static const uint16_t RPNBENDRANGE  = 0;
+    static const uint16_t RPNFINETUNE   = 1;
+    static const uint16_t RPNCOARSETUNE = 2;
+    static const uint16_t RPNNULL       = 0x3fff;
+
+    // Pitch limits, larger bend ranges and tunings are clamped
+    static const uint8_t MAXBENDRANGE   = 24; // semitones
+    static const int8_t MAXCOARSETUNE   = 24; // semitones up or down
+    static const int MAXPITCHSEMITONES  = 48; // bend, tuning and vibrato together
+
+    void begin(uint8_t defaultStyle);
+    bool programChange(uint8_t number);
+    bool controlChange(uint8_t number, uint8_t value);
+    void pitchBendChange(int bend);
+    void updatePitchFactor(float lfo);
+    int32_t pitchIncrement(int32_t noteIncrement) const;
+    bool isFilterOn() const {
+      return (filterCutoff < 127) || (filterResonance > 0) || (filterEnvelope < 64);
+    }
+    bool isHeldBySostenuto(uint8_t note) const {
+      return sostenutoPedal && sostenutoKeys.test(note);
+    }
+
+    // Patch
+    uint8_t style;
+    uint16_t attackMs;    // 0 = start at full level
+    uint16_t releaseMs;   // 0 = stop at the next zero crossing
+    uint8_t bendRange;    // semitones for a full pitch bend, 0..MAXBENDRANGE
+    uint8_t bendRangeCents; // and cents
+    int8_t coarseTune;    // semitones, -MAXCOARSETUNE..MAXCOARSETUNE
+    int16_t fineTune;     // cents, -100..100
+    uint8_t priority;     // voices of low priority channels are stolen first
+    uint8_t velocityCurve; // VelocityCurves curve for the note gain
+    uint8_t filterCutoff;  // CC74, MIDI note of the cutoff, 127 = filter off
+    uint8_t filterResonance; // CC71
+    uint8_t filterEnvelope;  // CC79, 64 = none, semitones at full envelope above 64
+    uint8_t filterKeyTrack;  // CC80, 127 = cutoff follows the note
+
+    // Controllers
+    uint8_t volume;       // CC7
+    uint8_t expression;   // CC11
+    uint8_t modulation;   // CC1, vibrato depth
+    int16_t pitchBend;    // -8192..8191
+    uint16_t rpn;         // registered parameter selected for data entry
+    bool sustainPedal;    // CC64
+    bool sostenutoPedal;  // CC66
+
+    // Note state for the pedals
+    NoteSet keysDown;     // note on received, no note off yet
+    NoteSet sustained;    // note off received, note held by a pedal
+    NoteSet sostenutoKeys; // keys that were down when sostenuto was pressed
+
+    // Derived per block values
+    int32_t gain;         // Q15 from volume and expression
+    int32_t attackStep;   // Q15 envelope change per BUFFERSIZE samples
+    int32_t releaseStep;  // Q15 envelope change per BUFFERSIZE samples, 0 = zero crossing stop
+    int32_t pitchFactor;  // Q16 frequency factor from bend, tuning and vibrato
+
+    int activeVoices;     // voices playing or releasing a note of this channel
+
+private:
+    uint16_t fineTuneData; // 14 bit RPN value of the fine tune
+
+    void updateGain();
+    void updateEnvelope();
+    void dataEntry(uint8_t value, bool msb);
+};
+
+// Converts an envelope time to a Q15 step per block of BUFFERSIZE samples
+int32_t envelopeStep(uint16_t ms);
+
+// Maps a sound controller value 0..127 on a squared curve to 0..4 seconds
+uint16_t controllerToMs(uint8_t value);
+
+// -----------------------------------------------------------------------------
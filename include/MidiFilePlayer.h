@@ -0,0 +1,129 @@
+/*!
+ *  @file       MidiFilePlayer.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Plays a Standard MIDI File, type 0 or 1, straight from memory.
+ *
+ * The file is read in place, from a memory mapped file on a host or a
+ * memory mapped flash partition on the ESP32, nothing of it is copied to
+ * RAM. Each track keeps a read position and the tick of its next event, a
+ * heap of the tracks ordered by that tick merges them. Tempo changes are
+ * applied as they are reached, so the tempo map is followed without a pass
+ * over the file. SMPTE time division is supported as well.
+ *
+ * The player is a MIDI input port: available() and read() give the bytes of
+ * the events that are due, so a MidiInterface reads the file through the
+ * same parser and handlers as the live input. Meta events are used by the
+ * player and not passed on. stop() and the end of the file send a note
+ * off for every note the file left sounding.
+ */
+class MidiFilePlayer
+{
+public:
+    static const int MAXTRACKS = 16;
+
+    struct Stats {
+        uint32_t events;       // messages passed on
+        uint32_t tempoChanges;
+        uint32_t loops;
+        uint32_t errors;       // truncated chunks or events, unsupported parts
+    };
+
+    bool open(const uint8_t *toFile, size_t size);
+    void close();
+    void start(uint32_t nowMicros, bool loop = false);
+    void stop();
+    void update(uint32_t nowMicros);
+    bool isPlaying() const { return playing; }
+    bool isOpen() const { return nrOfTracks > 0; }
+    int getNrOfTracks() const { return nrOfTracks; }
+    uint32_t getTempo() const { return tempo; } // micros per quarter note
+    const Stats &getStats() const { return stats; }
+
+    // MIDI input port for MidiInterface
+    void begin(long baudRate) {}
+    int available();
+    int read();
+    size_t write(uint8_t value) { return 1; }
+
+private:
+    struct Track {
+        const uint8_t *toStart;
+        const uint8_t *toNext;  // next event, after its delta time
+        const uint8_t *toEnd;
+        uint32_t tick;          // of the next event
+        uint8_t runningStatus;
+        bool ended;
+    };
+
+    bool nextMessage();
+    bool readEvent(Track *toTrack);
+    bool readVariable(Track *toTrack, uint32_t *toValue);
+    void readDelta(Track *toTrack);
+    void rewind();
+    uint64_t tickMicros(uint32_t tick) const;
+    bool isBefore(int first, int second) const;
+    void pushTrack(int track);
+    int popTrack();
+    bool nextNoteOff();
+
+    Track tracks[MAXTRACKS];
+    int nrOfTracks = 0;
+    uint8_t heap[MAXTRACKS]; // tracks with events left, earliest first
+    int heapSize = 0;
+    uint16_t division = 96;  // ticks per quarter note, or SMPTE frames and ticks per frame
+
+    uint32_t tempo = 500000;
+    uint32_t segmentTick = 0;   // tick and time of the last tempo change
+    uint64_t segmentMicros = 0;
+    uint32_t lastTick = 0;      // tick of the last event of this pass
+
+    bool playing = false;
+    bool looping = false;
+    bool stopping = false;      // sending note offs after stop()
+    uint32_t lastMicros = 0;
+    uint64_t elapsedMicros = 0; // since start()
+    uint64_t passMicros = 0;    // start of this pass through the file
+
+    // Message being passed on: header bytes, then data bytes read in place
+    uint8_t header[3];
+    int headerSize = 0;
+    const uint8_t *toData = NULL;
+    uint32_t dataSize = 0;
+    uint32_t sent = 0;
+
+    uint32_t sounding[16][4] = {}; // notes on per channel, for stop()
+    Stats stats = {};
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,85 @@
+/*!
+ *  @file       MidiRecorder.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Ring of the parsed MIDI messages, for replaying a performance.
+ *
+ * Each message is stored with the sample clock of the synthesizer, the
+ * first sample of the block it acts on. A replay that delivers the message
+ * before the same block renders the same audio. Entries are 8 bytes with
+ * up to 3 message bytes, a longer SysEx message takes several entries.
+ * When the ring is full the oldest messages are overwritten, so the ring
+ * always holds the last part of the performance. The ring is rounded up to
+ * a power of two entries, so the write count can wrap at 2^32 and the
+ * entry of a position stays its low bits. format() prints the
+ * messages as text lines that tools/replay.cpp reads back.
+ */
+class MidiRecorder
+{
+public:
+    struct Entry {
+        uint32_t sample;
+        uint8_t size;    // message bytes in data, CONTINUED when part of the message before
+        uint8_t data[3];
+    };
+    static const uint8_t SIZEMASK  = 0x03;
+    static const uint8_t CONTINUED = 0x80;
+
+    bool begin(int nrOfEntries);
+    void record(uint32_t sample, const uint8_t *message, int size);
+    void record(uint32_t sample, uint8_t status, uint8_t data1, uint8_t data2);
+    void setRecording(bool on) { recording = on; }
+    bool isRecording() const { return recording; }
+
+    // Positions of the oldest entry in the ring and behind the newest
+    uint32_t getFirst() const;
+    uint32_t getEnd() const { return writeCount; }
+    uint32_t getMessages() const { return messages; }
+    uint32_t getOverwritten() const;
+
+    // The message at the position as "sample hex bytes", moves the position
+    // past it. Returns false when there are no more messages.
+    bool format(uint32_t *toPosition, char *text, int size) const;
+
+    static int messageSize(uint8_t status);
+
+private:
+    Entry *toEntries = NULL;
+    int nrOfEntries = 0;     // a power of two
+    uint32_t writeCount = 0; // entries ever written, wraps
+    bool full = false;       // writeCount went round the ring once
+    uint32_t messages = 0;
+    bool recording = true;
+};
+
+// -----------------------------------------------------------------------------
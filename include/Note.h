@@ -41,12 +41,10 @@ class Note
 public:
     uint32_t *samples[NROFSTYLES];
     int sampleSizes[NROFSTYLES];
-    uint32_t sampleErrors[NROFSTYLES];
     int midiNoteNr;
-    int delta;
+    int32_t phaseIncrement; // quarter wave samples per output sample, Q16
     double frequency;
     char name[MAXNOTENAME];
-    void *toWaveGenerator;
 private:
 };
 
@@ -0,0 +1,91 @@
+/*!
+ *  @file       OutputPipeline.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Ring of rendered blocks between the render loop and the output task.
+ *
+ * One producer renders into the block at the write count, one consumer
+ * sends the block at the read count to the I2S DMA. Every block has room
+ * for blockSize samples and carries the nr of samples rendered into it. Each side only moves
+ * its own counter, so a handoff is a single atomic store and neither side
+ * takes a lock. With a depth of N the render can run N blocks ahead of the
+ * output, which absorbs N blocks of render jitter and adds up to N blocks
+ * of latency. The counters run free and wrap at 2^32, the blocks are a power
+ * of two so the slot of a count is its low bits and stays in order across
+ * the wrap.
+ */
+class OutputPipeline
+{
+public:
+    static const int MAXDEPTH = 8; // a power of two
+
+    struct Stats {
+        uint32_t written;   // blocks handed to the output
+        uint32_t sent;      // blocks taken by the output
+        uint32_t underruns; // output found no block and sent silence
+        uint32_t fullWaits; // render found no free block
+        int minFill;        // fewest blocks queued when the output took one
+        int maxFill;
+    };
+
+    bool begin(int depth, int blockSize);
+    int getDepth() const { return depth; }
+    int getFill() const { return (int) (writeCount.load(std::memory_order_acquire) - readCount.load(std::memory_order_acquire)); }
+
+    // Render side
+    uint32_t *getWriteBlock();
+    void commitWrite(int size);
+    int getQueuedSamples() const;
+
+    // Output side
+    uint32_t *getReadBlock(int *toSize);
+    void commitRead();
+    void countUnderrun() { stats.underruns++; }
+
+    uint32_t getAddedLatencyMicros(int sampleRate) const;
+    const Stats &getStats() const { return stats; }
+    void resetStats();
+
+private:
+    uint32_t *toBlocks = NULL; // slotMask + 1 blocks of blockSize stereo samples
+    int sizes[MAXDEPTH] = {};  // samples in each block, set before the write count moves
+    int depth = 0;
+    uint32_t slotMask = 0;     // depth rounded up to a power of two, minus 1
+    int blockSize = 0;
+    std::atomic<uint32_t> writeCount{0}; // only changed by the render side
+    std::atomic<uint32_t> readCount{0};  // only changed by the output side
+    Stats stats = {};
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,112 @@
+/*!
+ *  @file       ParallelRender.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "Arena.h"
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Renders the voices of one block on several cores.
+ *
+ * The calling thread is worker 0 and renders into the mix itself, the
+ * other workers render into their own partial buffer. Voices are dealt
+ * round robin in the order they are passed. Starting a block bumps a
+ * generation counter, every worker adds one to a done counter when its
+ * part is ready and the caller spins on that counter, so there are no
+ * locks. The partial buffers are then added to the mix in worker order.
+ * Voices only add integer samples to the mix, so the output is the same
+ * bit for bit with any number of workers.
+ *
+ * Waking a worker and merging its partial buffer costs about as much as
+ * rendering a few voices, so a block only uses as many workers as have
+ * MINITEMSPERWORKER voices each, and never more than there are cores. With
+ * fewer voices, or on a single core host, the caller renders the block
+ * alone and the parallel path costs nothing.
+ *
+ * On the ESP32 the workers are FreeRTOS tasks woken by a task
+ * notification, on a Linux host they are std::threads polling the
+ * generation counter, so scaling and determinism can be checked there.
+ */
+class ParallelRender
+{
+public:
+    static const int MAXWORKERS = 8;
+    static const int MINITEMSPERWORKER = 4; // fewer voices are rendered by fewer workers
+
+    // Adds the samples of one item (voice) to mix, scratch is a free buffer
+    // of bufferSize samples of the worker
+    typedef void (*RenderFunction)(void *toContext, int item, int32_t mix[], int32_t scratch[], int bufferSize);
+
+    static size_t arenaBytes(int nrOfWorkers, int bufferSize);
+    bool begin(int nrOfWorkers, int bufferSize, RenderFunction function, void *toContext, Arena *toArena);
+    void end();
+    void render(const int items[], int nrOfItems, int32_t mix[], int bufferSize);
+    int getNrOfWorkers() const { return nrOfWorkers; }
+    void setMaxActiveWorkers(int count);
+    void setMinItemsPerWorker(int count);
+    int getMaxActiveWorkers() const { return maxActiveWorkers; }
+    int getActiveWorkers() const { return activeWorkers; }
+    int32_t *getScratch() const { return workers[0].toScratch; }
+
+private:
+    struct Worker {
+        ParallelRender *toOwner;
+        int index;
+        int32_t *toPartial; // NULL for worker 0, it renders into the mix
+        int32_t *toScratch;
+        void *toTask;
+    };
+
+    Worker workers[MAXWORKERS] = {};
+    int nrOfWorkers = 0;
+    int maxActiveWorkers = 1; // workers on different cores
+    int activeWorkers = 1;    // workers that render the block in progress
+    int minItemsPerWorker = MINITEMSPERWORKER;
+    int maxBufferSize = 0;
+    RenderFunction renderFunction = NULL;
+    void *toContext = NULL;
+
+    // The block in progress, written before the generation is bumped
+    const int *toItems = NULL;
+    int nrOfItems = 0;
+    int bufferSize = 0;
+
+    // Block count << 4 | activeWorkers, the host workers read both at once
+    std::atomic<uint32_t> generation{0};
+    std::atomic<int> done{0};
+    std::atomic<bool> running{false};
+
+    void renderPart(int worker, int32_t mix[]);
+    bool startWorker(Worker *toWorker);
+    static void workerLoop(void *toWorker);
+};
+
+// -----------------------------------------------------------------------------
@@ -27,9 +27,23 @@
 
 #pragma once
 
+#include <atomic>
 #include "WaveGenerator.h"
 #include "WaveFactory.h"
 #include "AC101.h"
+#include "CodecControl.h"
+#include "MidiChannel.h"
+#include "VoiceAllocator.h"
+#include "VelocityCurve.h"
+#include "VoiceFilter.h"
+#include "Effects.h"
+#include "Arena.h"
+#include "Profiler.h"
+#include "Limiter.h"
+#include "Governor.h"
+#include "ParallelRender.h"
+#include "OutputPipeline.h"
+#include "LatencyTrace.h"
 
 #include "constants.h"
 
@@ -42,33 +56,158 @@ class PolySynth
 {
 public:
 
-    void begin();
+    void begin(int nrOfVoices = NROFWAVEGENERATORS, int renderWorkers = RENDERWORKERS,
+      int pipelineDepth = PIPELINEDEPTH);
     void loop();
 
     void testGenerate(byte pitch1, byte pitch2);
 
-    // MIDI message handling
-    void startNote(byte pitch, byte velocity);
-    void stopNote(byte pitch, byte velocity);
+    // MIDI message handling, channels are numbered 1..16 as in the MIDI library
+    void setMidiTimes(uint32_t byteMicros, uint32_t parseMicros);
+    void startNote(byte channel, byte pitch, byte velocity);
+    void stopNote(byte channel, byte pitch, byte velocity);
+    void controlChange(byte channel, byte number, byte value);
+    bool programChange(byte channel, byte number);
+    void pitchBend(byte channel, int bend);
+    bool systemExclusive(const byte *data, unsigned size);
+    void midiClock();
+    void setEffect(uint8_t parameter, uint8_t value);
     void setVolume(uint8_t volume);
+    void setMasterVolume(uint8_t volume);
     void setStyle(byte style);
+    void setStealPolicy(int policy);
+    void setChannelPriority(byte channel, uint8_t priority);
+    void setVoiceLimit(int limit);
+    void setBlockSize(int size);
+    void setDmaBuffers(int count, int length);
+    void setOutputProfile(int profile);
+
+    static const int AUTOVOICELIMIT = 0; // voice limit follows the CPU budget
+    static const int ADAPTIVEBLOCKSIZE = 0; // block size follows the voices and the load
+
+    // Output profiles, block size and DMA buffers
+    static const int LOWLATENCYPROFILE  = 0; // 64 sample blocks, 2 DMA buffers of 64
+    static const int BALANCEDPROFILE    = 1; // 128, 2 of 128
+    static const int SAFEPROFILE        = 2; // 256, 2 of 256, the default
+    static const int ADAPTIVEPROFILE    = 3; // 64..256, 4 of 64
+    static const int CUSTOMPROFILE      = 4; // set with setBlockSize() and setDmaBuffers()
+    static const int NROFOUTPUTPROFILES = 5;
+
+    void printStats();
+
+    // Bytes taken from the arena by each part, alignment included
+    struct MemoryStats {
+        size_t tableBytes;  // wave tables
+        size_t voiceBytes;  // voice pool and render buffers
+        size_t effectBytes; // delay lines of the effects
+        size_t arenaBytes;  // size of the arena
+        size_t peakBytes;   // most of the arena in use
+        int arenaChunks;    // heap blocks the arena is made of
+    };
+    MemoryStats getMemoryStats() const;
+    void printMemory();
+
+    // Samples rendered since begin(), the block after a message starts here
+    uint32_t getSampleClock() const { return sampleClock; }
+    int getNrOfVoices() const { return nrOfVoices; }
+    int getVoiceLimitSetting() const { return autoVoiceLimit ? AUTOVOICELIMIT : voiceLimit; }
+    int getOutputProfile() const { return outputProfile; }
 
     static const byte SINUSSTYLE    = 0;
     static const byte TRIANGLESTYLE = 1;
     static const byte SQUARESTYLE   = 2;
+
+    // SysEx messages: F0 SYSEXID command data.. F7
+    static const byte SYSEXID                  = 0x7D; // non-commercial manufacturer id
+    static const byte SYSEXCUSTOMVELOCITYCURVE = 0x01; // 128 values 0..127
+    static const byte SYSEXSELECTVELOCITYCURVE = 0x02; // channel 0..15 or 0x7F for all, curve
+    static const byte SYSEXEFFECTPARAMETER     = 0x03; // Effects parameter, value
+    static const byte SYSEXOUTPUTPROFILE       = 0x04; // profile 0..3
 private:
-    uint32_t buffer[BUFFERSIZE];
-    WaveGenerator wavegenerators[NROFWAVEGENERATORS];
+    struct LatencyStats {
+        uint32_t notes;
+        uint32_t maxMicros;
+        uint64_t totalMicros;
+    };
+
+    uint32_t buffer[BUFFERSIZE]; // output block when there is no pipeline
+    int blockSize = BUFFERSIZE;  // samples rendered per block
+    uint32_t sampleClock = 0;    // samples rendered since begin()
+    int nextBlockSize = BUFFERSIZE;
+    bool adaptiveBlockSize = false;
+    int adaptiveBlocks = 0;
+    int adaptiveHold = 0;
+    int dmaBuffers = NROFBUFFERS;
+    int dmaLength = BUFFERSIZE;
+    std::atomic<uint32_t> pendingDma{0}; // count << 16 | length, set by setDmaBuffers()
+    int outputProfile = SAFEPROFILE;
+    LatencyStats latencyStats[NROFOUTPUTPROFILES] = {}; // note on to output
+    LatencyTrace latencyTrace;
+    uint32_t midiByteMicros = 0; // times of the MIDI message for the next note on
+    uint32_t midiParseMicros = 0;
+    uint32_t silence[BUFFERSIZE] = {}; // sent when the pipeline runs empty
+    OutputPipeline outputPipeline;
+    void *toOutputTask = NULL;
+    void *toRenderTask = NULL;
+    int32_t mix[BUFFERSIZE]; // mono mix bus, 32 bits so large chords do not clip before the limiter
+    int32_t mixRight[BUFFERSIZE]; // right channel when the effects are on, mix is left
+    WaveGenerator *wavegenerators = NULL; // pool of nrOfVoices, in the arena
+    int activeVoices[MAXWAVEGENERATORS]; // generators rendered in this block
+    ParallelRender voiceRender;
+    int nrOfVoices = NROFWAVEGENERATORS;
+    bool autoVoiceLimit = true;
+    int voiceLimit = NROFWAVEGENERATORS; // fixed or from the CPU budget, before the governor cap
+    int governorVoiceCap = 0; // voices the governor allows, 0 when it does not cap
+    uint32_t voiceCost = 0; // micros per voice per block in Q8, averaged
+    int renderedVoices = 0; // voices rendered in the last block
+    int voiceLimitBlocks = 0;
     int bytesWritten; // For debugging
     WaveFactory waveFactory;
 
     AC101 ac; // Audio chip
-    uint8_t volume = 32;
-    WaveGenerator *toFreeWaveGenerators;
-//    byte style = SINUSSTYLE;
-    byte style = TRIANGLESTYLE;
+    CodecControl codecControl; // Runs I2C traffic to the audio chip off the audio path
+    uint8_t volume = 32; // Audio chip volume, only set at configuration time
+    SmoothedGain masterGain;
+    MidiChannel channels[NROFMIDICHANNELS]; // indexed by MIDI channel 0..15
+    VoiceAllocator voiceAllocator;
+    VelocityCurves velocityCurves;
+    FilterTables filterTables;
+    Arena arena; // wave tables, voices and delay lines, sized in begin()
+    size_t voiceBytes = 0;
+    size_t effectBytes = 0;
+    Effects effects;
+    Profiler profiler;
+    Limiter limiter;
+    Governor governor;
+    uint32_t lastClockMicros = 0;  // MIDI clock tempo measurement
+    uint32_t clockMicros = 0;
+    int clockCount = 0;
+    int32_t stealFadeStep;
+    float vibratoPhase = 0.0; // radians, shared by all channels
+    float vibratoLfo = 0.0;   // LFO value of the current block, -1..1
 
-    void initFreeWaveGenerators();
+    static size_t voiceArenaBytes(int nrOfVoices, int renderWorkers);
+    void startVoice(WaveGenerator *toWaveGenerator, int channelIndex, byte pitch, byte velocity);
+    void releaseVoice(WaveGenerator *toWaveGenerator, int channelIndex, byte pitch);
+    int32_t voiceGain(WaveGenerator *toWaveGenerator, int32_t envelopeLevel);
+    int32_t voiceIncrement(WaveGenerator *toWaveGenerator);
+    static void renderVoice(void *toSynth, int voice, int32_t mix[], int32_t scratch[], int bufferSize);
+    void updateFilter(WaveGenerator *toWaveGenerator, int32_t envelopeLevel);
+    void updatePitch();
+    void enforceVoiceLimit();
+    void updateVoiceLimit();
+    void applyVoiceLimit();
+    void applyGovernor();
+    void setSustainPedal(int channelIndex, bool down);
+    void setSostenutoPedal(int channelIndex, bool down);
+    void releaseHeldNotes(int channelIndex, const NoteSet &notes);
+    void writeBlock(const uint32_t *toBlock, int size);
+    void reconfigureDma();
+    void changeBlockSize(int size);
+    void updateBlockSize();
+    void printLatency();
+    void traceOutput(int nrOfActive, int outputSize);
+    static void outputTask(void *toPolySynth);
     bool setPinout(int bclk, int wclk, int dout);
     void installDriver(int i2sBufferSize, int i2sNrOfBuffers);
 };
@@ -0,0 +1,76 @@
+/*!
+ *  @file       Profiler.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Render time per block, split in sections.
+ *
+ * startBlock() takes the time, every endSection() charges the time since
+ * the previous mark to that section. The wait for the I2S DMA is outside
+ * the block, so the total is the CPU time of rendering.
+ */
+class Profiler
+{
+public:
+    static const int VOICESECTION   = 0; // oscillators, filters, envelopes
+    static const int EFFECTSSECTION = 1; // chorus and delay
+    static const int OUTPUTSECTION  = 2; // master gain and output format
+    static const int NROFSECTIONS   = 3;
+
+    struct Section {
+        uint32_t last;  // micros in the last block
+        uint32_t max;
+        uint64_t total; // since reset, for the average
+    };
+
+    void begin(uint32_t blockMicros);
+    void reset();
+    void startBlock();
+    void endSection(int section);
+    void endBlock();
+    const Section &getSection(int section) const { return sections[section]; }
+    uint32_t getLastBlockMicros() const { return lastBlock; }
+    uint32_t getBlockMicros() const { return blockPeriod; }
+    void setBlockMicros(uint32_t blockMicros) { blockPeriod = blockMicros; }
+    void printStats();
+
+private:
+    Section sections[NROFSECTIONS] = {};
+    uint32_t blockPeriod = 0;   // micros of audio in one block
+    uint32_t blocks = 0;
+    uint32_t blockStart = 0;
+    uint32_t mark = 0;
+    uint32_t lastBlock = 0;
+    uint32_t maxBlock = 0;
+    uint64_t totalBlock = 0;
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,78 @@
+/*!
+ *  @file       Reverb.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Arena.h"
+#include "DelayLine.h"
+
+// -----------------------------------------------------------------------------
+
+static const int REVERBNROFLINES = 4;
+static const int REVERBNROFDIFFUSERS = 2;
+
+/*! \brief Feedback delay network reverb in fixed point.
+ *
+ * Two Schroeder all pass filters diffuse the input, which then feeds four
+ * delay lines mixed by a Hadamard matrix. Each line has a one pole low pass
+ * for the damping and a feedback gain for the reverb time. The line lengths
+ * follow the sample rate and are scaled down together when they do not fit
+ * in the RAM budget, which makes the room smaller but keeps its character.
+ */
+class Reverb
+{
+public:
+    static size_t arenaBytes(int rate, size_t budget);
+    bool begin(Arena *toArena, int rate, size_t budget);
+    void clear();
+    void setTime(uint8_t value);
+    void setDamping(uint8_t value);
+    void process(int32_t input, int32_t *toLeft, int32_t *toRight);
+
+    // For the host benchmark, which runs a float version of the same network
+    int getLineLength(int line) const { return lines[line].getLength(); }
+    int getDiffuserLength(int diffuser) const { return diffusers[diffuser].getLength(); }
+    float getTimeSeconds() const { return timeSeconds; }
+    int32_t getFeedback(int line) const { return feedback[line]; }
+    int32_t getLowpassCoefficient() const { return lowpassCoefficient; }
+
+private:
+    DelayLine lines[REVERBNROFLINES];
+    DelayLine diffusers[REVERBNROFDIFFUSERS];
+    int32_t lowpass[REVERBNROFLINES] = {};
+    int32_t feedback[REVERBNROFLINES] = {}; // Q15
+    int32_t lowpassCoefficient = 0x7fff;    // Q15, 0x7fff = no damping
+    float timeSeconds = 2.0;
+    int rate = 0;
+
+    static void lengths(int rate, size_t budget, int lineLengths[], int diffuserLengths[]);
+    void updateFeedback();
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,61 @@
+/*!
+ *  @file       VelocityCurve.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+static const int NROFVELOCITIES = 128;
+
+/*! \brief Tables that map a MIDI note on velocity to a Q15 note gain.
+ *
+ * All curves are computed in begin(), so a note on only costs one table
+ * fetch. The custom curve can be loaded by SysEx.
+ */
+class VelocityCurves
+{
+public:
+    static const uint8_t LINEARCURVE      = 0; // gain proportional to velocity
+    static const uint8_t EXPONENTIALCURVE = 1; // 40 dB range, equal steps in dB
+    static const uint8_t FIXEDCURVE       = 2; // full gain, velocity ignored
+    static const uint8_t CUSTOMCURVE      = 3; // loaded by SysEx, linear until then
+    static const int NROFCURVES = 4;
+
+    void begin();
+    inline int32_t getGain(uint8_t curve, uint8_t velocity) const {
+      return curves[curve][velocity & 0x7f];
+    }
+    void setCustomCurve(const uint8_t values[NROFVELOCITIES]);
+
+private:
+    uint16_t curves[NROFCURVES][NROFVELOCITIES]; // Q15
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,110 @@
+/*!
+ *  @file       VoiceAllocator.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#pragma once
+
+#include <stdint.h>
+#include "WaveGenerator.h"
+#include "MidiChannel.h"
+
+// -----------------------------------------------------------------------------
+
+static const uint8_t NOVOICE = 0xff;
+static const int NROFVOICEMASKWORDS = (MAXWAVEGENERATORS + 31) / 32;
+
+/*! \brief Hands out wave generators (voices) to new notes.
+ *
+ * Voices are shared fairly between the playing channels. When no voice may
+ * be taken from the free list, a playing voice is stolen according to the
+ * steal policy; the stolen voice fades out and then plays the new note.
+ * Releasing voices are stolen first, then voices only held by a pedal.
+ *
+ * Free voices are bits in a mask, found with a find-first-set. The voice
+ * that plays a note is kept in a table indexed by channel and note, so
+ * retriggered notes and equal notes on several channels never share a voice.
+ *
+ * The voice limit caps the voices in use below the size of the pool, it
+ * can change while playing; voices above it are faded out.
+ */
+class VoiceAllocator
+{
+public:
+    static const int STEALNONE           = 0; // drop the new note
+    static const int STEALOLDEST         = 1; // voice that started first
+    static const int STEALQUIETEST       = 2; // voice with the lowest gain
+    static const int STEALLOWESTPRIORITY = 3; // oldest voice of the channel with lowest priority
+
+    struct Stats {
+        uint32_t allocations; // voices taken from the free list
+        uint32_t steals;      // playing voices taken over by a new note
+        uint32_t drops;       // notes that did not get a voice
+        int peakPolyphony;    // most voices in use at the same time
+    };
+
+    void begin(WaveGenerator *toVoices, int nrOfVoices, MidiChannel *toChannels);
+    void setStealPolicy(int policy);
+    WaveGenerator *allocate(int channelIndex, WaveGenerator **toStolen);
+    void freeVoice(WaveGenerator *toVoice);
+    void cancelSteal(WaveGenerator *toVoice);
+    void takeOver(WaveGenerator *toVoice);
+    void setVoiceLimit(int limit);
+    int getVoiceLimit() const { return voiceLimit; }
+    int getNrOfVoices() const { return nrOfVoices; }
+    WaveGenerator *findExcessVoice();
+
+    // Voice ownership by (channel, note)
+    WaveGenerator *findVoice(int channelIndex, uint8_t pitch);
+    void assign(int channelIndex, uint8_t pitch, WaveGenerator *toVoice);
+    void unassign(int channelIndex, uint8_t pitch, WaveGenerator *toVoice);
+
+    int getActiveVoices() const { return nrOfVoices - nrOfFreeVoices; }
+    const Stats &getStats() const { return stats; }
+    void printStats();
+
+private:
+    WaveGenerator *toVoices = NULL;
+    int nrOfVoices = 0;
+    MidiChannel *toChannels = NULL;
+    uint32_t freeVoices[NROFVOICEMASKWORDS]; // bit set = voice is free
+    int nrOfFreeVoices = 0;
+    int voiceLimit = 0;
+    uint8_t owners[NROFMIDICHANNELS][MAXMIDINOTES+1]; // voice index or NOVOICE
+    int stealPolicy = STEALOLDEST;
+    uint32_t startCounter = 0;
+    Stats stats = {};
+
+    WaveGenerator *takeFreeVoice();
+    int fairShare(int channelIndex);
+    bool mayTakeFreeVoice(int channelIndex, int share);
+    WaveGenerator *findVictim(int channelIndex, int share);
+    bool isBetterVictim(WaveGenerator *toCandidate, WaveGenerator *toBest);
+    int stealClass(WaveGenerator *toVoice);
+    int32_t loudness(WaveGenerator *toVoice);
+};
+
+// -----------------------------------------------------------------------------
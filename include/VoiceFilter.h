@@ -0,0 +1,82 @@
+/*!
+ *  @file       VoiceFilter.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+ *  @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// -----------------------------------------------------------------------------
+
+static const int FILTERCOEFFICIENTBITS = 28;  // Q28 frequency and damping
+static const int FILTERSTATEBITS = 8;         // extra fraction bits of the state
+static const int FILTERNROFNOTES = 136;       // cutoff table, MIDI note 0..135
+
+/*! \brief Cutoff and resonance tables of the voice filter for one sample rate.
+ *
+ * The cutoff is given as a MIDI note in 1/256 semitones, so envelope and key
+ * tracking modulation are additions. The table holds one coefficient per
+ * semitone and is interpolated in between.
+ */
+class FilterTables
+{
+public:
+    static const int32_t OPENCUTOFF = 127 << 8; // CC74 127, filter is off
+
+    void begin(int sampleRate);
+    int32_t getFrequency(int32_t cutoff) const;
+    inline int32_t getDamping(uint8_t resonance) const {
+      return damping[resonance & 0x7f];
+    }
+
+private:
+    int32_t frequency[FILTERNROFNOTES]; // Q28, 2 sin(pi fc / fs)
+    int32_t damping[128];               // Q28, 1 / Q
+};
+
+/*! \brief Resonant low pass filter of one voice.
+ *
+ * Chamberlin state variable filter in fixed point. The coefficients are
+ * set once per block, process() then costs three multiplies per sample.
+ */
+class VoiceFilter
+{
+public:
+    void reset() { low = 0; band = 0; }
+    void setEnabled(bool on);
+    bool isEnabled() { return enabled; }
+    void setCoefficients(int32_t newFrequency, int32_t newDamping);
+    void process(const int32_t input[], int32_t mix[], int bufferSize);
+
+private:
+    bool enabled = false;
+    int32_t frequency = 0; // Q28
+    int32_t damping = 0;   // Q28
+    int32_t low = 0;       // state, samples with FILTERSTATEBITS fraction bits
+    int32_t band = 0;
+};
+
+// -----------------------------------------------------------------------------
@@ -27,8 +27,10 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include "Note.h"
+#include "Arena.h"
 
 // -----------------------------------------------------------------------------
 
@@ -37,27 +39,34 @@ static const int MAXMIDINOTES=127;
 static const int NROFNOTESINOCTAVE=12;
 
 /*! \brief Class that stores samples for one waveform for each note.
+ *
+ * Only the first octave has tables, taken from an Arena, the higher notes
+ * play them with larger phase increments.
  */
 class WaveFactory
 {
 public:
-    void begin();
-    // Notenr from 0..255 corresponding to MIDI notes
+    static size_t arenaBytes();
+    bool begin(Arena *toArena);
+    // Notenr from 0..255 corresponding to MIDI notes, NULL without tables
     Note *getNote(int noteNr);
+    size_t getTableBytes() const { return tableBytes; }
 
 private:
     Note notes[MAXMIDINOTES+1];
+    size_t tableBytes = 0; // taken from the arena, alignment included
+    bool ready = false;
 
     int makeSinusNote(
-        Note *toNote, double frequency, int midiNoteNr, 
+        Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
         char *toNoteName, int octaveNr
     );
     int makeTriangleNote(
-        Note *toNote, double frequency, int midiNoteNr, 
+        Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
         char *toNoteName, int octaveNr
     );
     int makeSquareNote(
-        Note *toNote, double frequency, int midiNoteNr, 
+        Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
         char *toNoteName, int octaveNr
     );
 
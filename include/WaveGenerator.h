@@ -28,6 +28,9 @@
 #pragma once
 
 #include "WaveFactory.h"
+#include "Gain.h"
+#include "VoiceFilter.h"
+#include "LatencyTrace.h"
 
 // -----------------------------------------------------------------------------
 
@@ -37,27 +40,61 @@ class WaveGenerator
 {
 public:
     void begin();
-    void setWave(uint32_t wave[], int waveSize, int delta, uint32_t error);
+    void setWave(uint32_t wave[], int waveSize, int32_t increment);
+    void setTargetIncrement(int32_t increment);
     void clearWave();
-    void setSamplesInBuffer(uint32_t buffer[], int bufferSize);
-    void addSamplesToBuffer(uint32_t buffer[], int bufferSize);
+    void addSamplesToMix(int32_t mix[], int bufferSize);
     void printSamples(uint16_t *toSamples, int samplesSize);
     void printBuffer(uint32_t buffer[], int bufferSize);
     bool clearStopping();
+    bool isActive();
+    void setGain(int32_t gain);
+    void setTargetGain(int32_t gain);
+    int32_t startEnvelope(int32_t attackStep);
+    void release(int32_t releaseStep);
+    int32_t advanceEnvelope(int bufferSize);
+    int32_t getEnvelopeLevel() { return envelopeLevel; }
+    bool isReleasing() { return releasing || stopping; }
+    void steal(int32_t fadeStep, uint8_t channel, uint8_t pitch, uint8_t velocity);
+    void fadeOut(int32_t fadeStep);
+    bool isFadingOut() { return fadingOut; }
+    bool hasPendingNote() { return pendingPitch != NOPENDINGNOTE; }
+    void clearPendingNote() { pendingPitch = NOPENDINGNOTE; }
 
-    WaveGenerator *toNextFreeWaveGenerator;
+    uint8_t channel = 0; // MIDI channel 0..15 of the note that is playing
+    uint8_t pitch = 0;   // MIDI note that is playing
+    int32_t noteIncrement = 0; // phase increment of the note without bend or tuning
+    uint32_t startOrder = 0; // allocation order, to find the oldest voice
+    int32_t velocityGain = UNITYGAIN; // Q15 note gain from the velocity curve
+    VoiceFilter filter;
+    LatencyTrace::Times trace = {}; // voiceMicros is 0 when not traced
+    int firstSample = -1; // first nonzero sample of a traced note in this block
+
+    // Note that starts when the fade out of a stolen voice is done
+    static const uint8_t NOPENDINGNOTE = 0xff;
+    uint8_t pendingChannel = 0;
+    uint8_t pendingPitch = NOPENDINGNOTE;
+    uint8_t pendingVelocity = 0;
 
 private:
     int state = 0;
     bool stopping = false;
 
     uint32_t *toStartWave;
-    uint32_t *toEndWave;
-    uint32_t *toWave;
-    int delta = 0;
-    uint32_t prevValue = 0; // Used for debugging
-    uint32_t sampleError = 0; // used to compensate for sample versus frequency misalignment
-    uint32_t totalError = 0; // used to compensate for sample versus frequency misalignment
+    int waveSize = 0;
+    int32_t quarterLength = 0;   // waveSize in Q16
+    int32_t phase = 0;           // position in the current quarter, Q16
+    int32_t increment = 0;       // phase change per sample, Q16
+    int32_t targetIncrement = 0; // increment at the end of the block
+    SmoothedGain gain;
+    int32_t envelopeLevel = UNITYGAIN; // Q15, updated once per block
+    int32_t envelope = UNITYGAIN * BUFFERSIZE; // envelopeLevel times BUFFERSIZE, keeps the fraction of small blocks
+    int32_t attackStep = UNITYGAIN;
+    int32_t releaseStep = 0;
+    bool releasing = false;
+    bool fadingOut = false; // stolen or over the voice limit, a note off does not slow it down
+
+    int32_t limitIncrement(int32_t newIncrement);
 };
 
 // -----------------------------------------------------------------------------
@@ -28,11 +28,29 @@
 #pragma once
 
 #define ESP32POLYSYNTHVERSION "V1.0 2020-03-10"
-static const uint32_t WAVEPARTERRORMAX = (100000/2);
 static const int NROFSTYLES = 3;
-static const int NROFWAVEGENERATORS = 16;
-static const int BUFFERSIZE=256; // measured in samples
-static const int NROFBUFFERS=2;
+static const int NROFWAVEGENERATORS = 16; // default nr of voices
+static const int MAXWAVEGENERATORS = 64;  // voice pool, the nr of voices is set in begin()
+static const int RENDERWORKERS = 2;      // voices are rendered on both cores
+static const int CPUBUDGETPERCENT = 85;   // block time the voice limit may use
+static const int GOVERNORHIGHPERCENT = 90; // render load that makes the governor lower the quality
+static const int GOVERNORLOWPERCENT = 65;  // render load under which it restores it
+static const int NROFMIDICHANNELS = 16;
+static const int STEALFADEMS = 2; // fade out of a voice that is taken over by a new note
+static const float VIBRATORATEHZ = 5.5;
+static const float VIBRATODEPTHSEMITONES = 0.5; // at full modulation wheel
+static const bool COMPACTDELAYLINES = true; // effect delay lines store 16 bit samples
+static const int EFFECTSMINRATE = 44100; // effects run at the sample rate divided down to this
+static const int CHORUSMAXMS = 20;
+static const int DELAYMAXMS = 500;
+static const int REVERBRAMBYTES = 16384; // reverb delay lines are scaled down to fit
+static const int BUFFERSIZE=256; // largest block in samples, the block size is set at run time
+static const int MINBUFFERSIZE=32;
+static const int NROFBUFFERS=2;   // default nr of I2S DMA buffers
+static const int MAXDMABUFFERS=16;
+static const int MAXDMALENGTH=1024; // samples, limit of the I2S driver
+static const int PIPELINEDEPTH=2; // rendered blocks queued for the DMA, 0 writes from the loop
+static const int MIDIRECORDERENTRIES=2048; // 8 bytes each, the last parsed MIDI messages for a replay
 static const int APLL_DISABLE = 0;
 static const int SAMPLERATE = 192000;
 static const int PORTNR = 0;
@@ -42,7 +60,12 @@ static const int IIS_SCLK=27;
 static const int IIS_LCLK=26;
 static const int IIS_DSIN=25;
 
-static const int TOP=(((0xffff/2)/NROFWAVEGENERATORS)-0x10);
+// Wave tables use the full 16 bit range, the limiter on the mix keeps chords
+// from clipping
+static const int TOP=0x7fff;
+static const int LIMITERTHRESHOLD = 0x7800; // output peak, -0.6 dB
+static const float LIMITERKNEEDB = 6.0;
+static const int LIMITERRELEASEMS = 100;
 // static const int BASE=((0xffff/2)/NROFWAVEGENERATORS);
 static const int BASE=(0);
 static const int STEREOTOP=((TOP << 16) + TOP);
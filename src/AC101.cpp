@@ -20,8 +20,10 @@
 */
 
 #include "AC101.h"
-#include <Wire.h>
+#include <string.h>
+#ifdef ARDUINO
 #include <Arduino.h>
+#endif
 
 #define AC101_ADDR			0x1A				// Device address
 
@@ -135,43 +137,197 @@ const uint8_t regs[] = {
 	 DAC_DAP_ENA
 };
 
+// Status registers change by themselves and can never be served from the shadow registers
+static bool isVolatileReg(uint8_t reg)
+{
+	return (reg == CHIP_AUDIO_RS) or (reg == HMIC_STATUS);
+}
+
+static inline bool testBit(const uint32_t *bits, uint8_t reg)
+{
+	return (bits[reg >> 5] >> (reg & 31)) & 1;
+}
+
+static inline void setBit(uint32_t *bits, uint8_t reg)
+{
+	bits[reg >> 5] |= uint32_t(1) << (reg & 31);
+}
+
+static inline void clearBit(uint32_t *bits, uint8_t reg)
+{
+	bits[reg >> 5] &= ~(uint32_t(1) << (reg & 31));
+}
+
 bool AC101::WriteReg(uint8_t reg, uint16_t val)
 {
-	Wire.beginTransmission(AC101_ADDR);
-	Wire.write(reg);
-	Wire.write(uint8_t((val >> 8) & 0xff));
-	Wire.write(uint8_t(val & 0xff));
-	return 0 == Wire.endTransmission(true);
+	if (CHIP_AUDIO_RS == reg)
+	{
+		// A reset brings all registers back to their defaults, write it directly
+		Flush();
+		stats.transactions++;
+		stats.writes++;
+		bool ok = bus->Write(AC101_ADDR, reg, &val, 1);
+		Invalidate();
+		return ok;
+	}
+
+	if (batchDepth > 0)
+	{
+		if (testBit(dirty, reg))
+		{
+			stats.coalesced++;
+		}
+		shadow[reg] = val;
+		setBit(valid, reg);
+		setBit(dirty, reg);
+		return true;
+	}
+
+	if (testBit(valid, reg) and (shadow[reg] == val) and not isVolatileReg(reg))
+	{
+		stats.skipped++;
+		return true;
+	}
+
+	stats.transactions++;
+	stats.writes++;
+	bool ok = bus->Write(AC101_ADDR, reg, &val, 1);
+	if (ok)
+	{
+		shadow[reg] = val;
+		setBit(valid, reg);
+	}
+	else
+	{
+		clearBit(valid, reg);
+	}
+	return ok;
 }
 
 uint16_t AC101::ReadReg(uint8_t reg)
 {
-	Wire.beginTransmission(AC101_ADDR);
-	Wire.write(reg);
-	Wire.endTransmission(false);
+	if (testBit(valid, reg) and not isVolatileReg(reg))
+	{
+		stats.cached++;
+		return shadow[reg];
+	}
+	return ReadRegUncached(reg);
+}
 
+uint16_t AC101::ReadRegUncached(uint8_t reg)
+{
 	uint16_t val = 0u;
-	if (2 == Wire.requestFrom(uint16_t(AC101_ADDR), uint8_t(2), true))
+	stats.transactions++;
+	stats.reads++;
+	if (bus->Read(AC101_ADDR, reg, &val) and not isVolatileReg(reg) and not testBit(dirty, reg))
 	{
-		val = uint16_t(Wire.read() << 8) + uint16_t(Wire.read());
+		shadow[reg] = val;
+		setBit(valid, reg);
 	}
-	Wire.endTransmission(false);
-
 	return val;
 }
 
-AC101::AC101()
+void AC101::Invalidate()
 {
+	for (size_t i = 0; i < ARRAY_SIZE(valid); ++i)
+	{
+		valid[i] = 0;
+		dirty[i] = 0;
+	}
+}
+
+void AC101::Delay(uint32_t ms)
+{
+	stats.delayMs += ms;
+	bus->DelayMs(ms);
+}
+
+void AC101::BeginBatch()
+{
+	batchDepth++;
+}
+
+bool AC101::EndBatch()
+{
+	if (batchDepth > 0)
+		batchDepth--;
+	if (batchDepth > 0)
+		return true;
+	return Flush();
+}
+
+bool AC101::Flush()
+{
+	bool ok = true;
+	uint16_t vals[256];
+
+	int reg = 0;
+	while (reg < 256)
+	{
+		if (not testBit(dirty, uint8_t(reg)))
+		{
+			reg++;
+			continue;
+		}
+		// Collect a run of consecutive dirty registers, up to the burst size
+		int first = reg;
+		uint8_t count = 0;
+		while ((reg < 256) and (count < maxBurst) and testBit(dirty, uint8_t(reg)))
+		{
+			vals[count++] = shadow[reg];
+			clearBit(dirty, uint8_t(reg));
+			reg++;
+		}
+		stats.transactions++;
+		stats.writes += count;
+		if (not bus->Write(AC101_ADDR, uint8_t(first), vals, count))
+		{
+			ok = false;
+			for (int r = first; r < first + count; ++r)
+				clearBit(valid, uint8_t(r));
+		}
+	}
+	return ok;
+}
+
+void AC101::SetMaxBurst(uint8_t registers)
+{
+	maxBurst = registers ? registers : 1;
+}
+
+#ifdef ARDUINO
+static AC101WireBus wireBus;
+#endif
+
+AC101::AC101(AC101Bus *toBus) : batchDepth(0), maxBurst(1), bus(toBus)
+{
+	memset(&stats, 0, sizeof(stats));
+	memset(&initStats, 0, sizeof(initStats));
+	Invalidate();
+#ifdef ARDUINO
+	if (NULL == bus)
+		bus = &wireBus;
+#endif
 }
 
 bool AC101::begin(int sda, int scl, uint32_t frequency)
 {
-	bool ok = Wire.begin(sda, scl, frequency);
+	if (NULL == bus)
+		return false;
+
+	bool ok = bus->Begin(sda, scl, frequency);
+
+	Stats_t before = stats;
+	uint32_t start = bus->Micros();
 
 	// Reset all registers, readback default as sanity check
 	ok &= WriteReg(CHIP_AUDIO_RS, 0x123);
-	delay(100);
-	ok &= 0x0101 == ReadReg(CHIP_AUDIO_RS);
+	Delay(100);
+	ok &= 0x0101 == ReadRegUncached(CHIP_AUDIO_RS);
+
+	// Collect the configuration in the shadow registers, the read-modify-write
+	// sequences on I2S1LCK_CTRL end up as a single write
+	BeginBatch();
 
 	ok &= WriteReg(SPKOUT_CTRL, 0xe880);
 
@@ -185,6 +341,7 @@ bool AC101::begin(int sda, int scl, uint32_t frequency)
 	ok &= WriteReg(MOD_RST_CTRL, 0x800c);
 
 	// Set default at I2S, 44.1KHz, 16bit
+	// I2S1LCK_CTRL is read once, the field updates below merge into one write
 	ok &= SetI2sSampleRate(SAMPLE_RATE_44100);
 	ok &= SetI2sClock(BCLK_DIV_8, false, LRCK_DIV_32, false);
 	ok &= SetI2sMode(MODE_SLAVE);
@@ -209,17 +366,30 @@ bool AC101::begin(int sda, int scl, uint32_t frequency)
 
 	ok &= SetMode( MODE_DAC );
 
+	ok &= EndBatch();
+
+	initStats.transactions = stats.transactions - before.transactions;
+	initStats.reads = stats.reads - before.reads;
+	initStats.writes = stats.writes - before.writes;
+	initStats.cached = stats.cached - before.cached;
+	initStats.skipped = stats.skipped - before.skipped;
+	initStats.coalesced = stats.coalesced - before.coalesced;
+	initStats.delayMs = stats.delayMs - before.delayMs;
+	initStats.micros = bus->Micros() - start;
+
 	return ok;
 }
 
 void AC101::DumpRegisters()
 {
+#ifdef ARDUINO
 	for (size_t i = 0; i < ARRAY_SIZE(regs); ++i)
 	{
 		Serial.print(regs[i], HEX);
 		Serial.print(" = ");
-		Serial.println(ReadReg(regs[i]), HEX);
+		Serial.println(ReadRegUncached(regs[i]), HEX);
 	}
+#endif
 }
 
 uint8_t AC101::GetVolumeSpeaker()
@@ -314,16 +484,20 @@ bool AC101::SetMode(Mode_t mode)
 	if ((MODE_DAC == mode) or (MODE_ADC_DAC == mode) or (MODE_LINE == mode))
 	{
 		// Enable Headphone output
+		// The output stages power up in steps, send each step before the next one
 		ok &= WriteReg(OMIXER_DACA_CTRL, 0xff80);
 		ok &= WriteReg(HPOUT_CTRL, 0xc3c1);	
+		ok &= Flush();
 		ok &= WriteReg(HPOUT_CTRL, 0xcb00);
-		delay(100);
+		ok &= Flush();
+		Delay(100);
 		ok &= WriteReg(HPOUT_CTRL, 0xfbc0);
 		ok &= SetVolumeHeadphone(30);
 
 		// Enable Speaker output
 		ok &= WriteReg(SPKOUT_CTRL, 0xeabd);
-		delay(10);
+		ok &= Flush();
+		Delay(10);
 		ok &= SetVolumeSpeaker(30);
 	}
 	return ok;
@@ -0,0 +1,74 @@
+/*
+	AC101 - An AC101 Codec driver library for Arduino
+	Copyright (C) 2019, Ivo Pullens, Emmission
+
+	Inspired by:
+	https://github.com/donny681/esp-adf/tree/master/components/audio_hal/driver/AC101
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AC101Bus.h"
+
+#ifdef ARDUINO
+
+#include <Wire.h>
+#include <Arduino.h>
+
+bool AC101WireBus::Begin(int sda, int scl, uint32_t frequency)
+{
+	return Wire.begin(sda, scl, frequency);
+}
+
+bool AC101WireBus::Write(uint8_t addr, uint8_t reg, const uint16_t *vals, uint8_t count)
+{
+	Wire.beginTransmission(addr);
+	Wire.write(reg);
+	for (uint8_t i = 0; i < count; ++i)
+	{
+		Wire.write(uint8_t((vals[i] >> 8) & 0xff));
+		Wire.write(uint8_t(vals[i] & 0xff));
+	}
+	return 0 == Wire.endTransmission(true);
+}
+
+bool AC101WireBus::Read(uint8_t addr, uint8_t reg, uint16_t *val)
+{
+	Wire.beginTransmission(addr);
+	Wire.write(reg);
+	Wire.endTransmission(false);
+
+	bool ok = false;
+	*val = 0u;
+	if (2 == Wire.requestFrom(uint16_t(addr), uint8_t(2), true))
+	{
+		*val = uint16_t(Wire.read() << 8) + uint16_t(Wire.read());
+		ok = true;
+	}
+	Wire.endTransmission(false);
+
+	return ok;
+}
+
+void AC101WireBus::DelayMs(uint32_t ms)
+{
+	delay(ms);
+}
+
+uint32_t AC101WireBus::Micros()
+{
+	return micros();
+}
+
+#endif
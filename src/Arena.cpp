@@ -0,0 +1,163 @@
+/*!
+ *  @file       Arena.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arena.h"
+
+#ifdef ARDUINO
+#include <esp_heap_caps.h>
+#endif
+
+// -----------------------------------------------------------------------------
+Arena::~Arena() {
+    freeChunks();
+}
+
+// Largest piece of the heap a single malloc can get
+size_t Arena::getLargestFreeBlock() {
+#ifdef ARDUINO
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#else
+    return (size_t) -1;
+#endif
+}
+
+void Arena::freeChunks() {
+    for(int index = 0; index < nrOfChunks; index++) {
+#ifdef ARDUINO
+      heap_caps_free(chunks[index].toMemory);
+#else
+      free(chunks[index].toMemory);
+#endif
+    }
+    nrOfChunks = 0;
+    current = 0;
+    size = 0;
+    used = 0;
+    peak = 0;
+}
+
+bool Arena::addChunk(size_t bytes) {
+    if (nrOfChunks == MAXCHUNKS)
+      return false;
+#ifdef ARDUINO
+    uint8_t *toMemory = (uint8_t *) heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+#else
+    uint8_t *toMemory = (uint8_t *) malloc(bytes);
+#endif
+    if (toMemory == NULL)
+      return false;
+    memset(toMemory, 0, bytes);
+    Chunk chunk = { toMemory, bytes, 0 };
+    chunks[nrOfChunks++] = chunk;
+    return true;
+}
+
+// Takes size bytes from the heap in as few chunks as the largest free block
+// allows, a previous arena is given back first
+bool Arena::begin(size_t newSize) {
+    freeChunks();
+    size_t remaining = newSize;
+    while (remaining > 0) {
+      size_t bytes = getLargestFreeBlock();
+      if (bytes > remaining)
+        bytes = remaining;
+      if ((bytes == 0) || !addChunk(bytes)) {
+        freeChunks();
+        return false;
+      }
+      remaining -= bytes;
+    }
+    size = newSize;
+    return true;
+}
+
+// Bytes taken from the heap, the chunks together
+size_t Arena::getSize() const {
+    size_t bytes = 0;
+    for(int index = 0; index < nrOfChunks; index++) {
+      bytes += chunks[index].size;
+    }
+    return bytes;
+}
+
+// Returns zeroed memory aligned to alignment bytes, a power of 2, NULL when
+// the arena is full
+void *Arena::allocate(size_t bytes, size_t alignment) {
+    if (used + bytes > size)
+      return NULL;
+    // The chunks behind the current one are still empty
+    for(int index = current; index < nrOfChunks; index++) {
+      Chunk *toChunk = &chunks[index];
+      uintptr_t address = (uintptr_t) (toChunk->toMemory + toChunk->end);
+      size_t start = toChunk->end + ((alignment - (address & (alignment - 1))) & (alignment - 1));
+      if (start + bytes <= toChunk->size) {
+        if (used + start + bytes - toChunk->end > size)
+          return NULL;
+        used += start + bytes - toChunk->end;
+        if (used > peak)
+          peak = used;
+        toChunk->end = start + bytes;
+        current = index;
+        return toChunk->toMemory + start;
+      }
+      // The room the pieces left at the ends of the chunks comes back as
+      // one more chunk
+      if ((index == nrOfChunks - 1) && (used + bytes + alignment <= size)) {
+        size_t topUp = size - used;
+        if (topUp > getLargestFreeBlock())
+          topUp = getLargestFreeBlock();
+        if ((topUp < bytes + alignment) || !addChunk(topUp))
+          return NULL;
+      }
+    }
+    return NULL;
+}
+
+// Gives back everything allocated after getUsed() returned mark, zeroed again
+void Arena::release(size_t mark) {
+    if (mark >= used)
+      return;
+    // Skips the chunks that stay whole, the next one becomes the current
+    // one and keeps the bytes up to the mark
+    int index = 0;
+    size_t kept = 0;
+    while (kept + chunks[index].end <= mark) {
+      kept += chunks[index].end;
+      index++;
+    }
+    int last = current;
+    current = index;
+    for(; index <= last; index++) {
+      Chunk *toChunk = &chunks[index];
+      size_t start = (index == current) ? mark - kept : 0;
+      memset(toChunk->toMemory + start, 0, toChunk->end - start);
+      toChunk->end = start;
+    }
+    used = mark;
+}
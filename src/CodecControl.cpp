@@ -0,0 +1,138 @@
+/*!
+ *  @file       CodecControl.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+
+#include "CodecControl.h"
+
+// -----------------------------------------------------------------------------
+static const int CODECTASKSTACKSIZE = 2048;
+static const int CODECTASKPRIORITY = 1; // lowest above idle
+static const int CODECTASKCORE = 0;     // audio loop runs on core 1
+
+#ifdef ARDUINO
+// Protects the slots, posting and servicing can run on different cores
+static portMUX_TYPE slotsMux = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+void CodecControl::begin(AC101 *toAudioCodec) {
+    toCodec = toAudioCodec;
+    for(int command = 0; command < NROFCOMMANDS; command++) {
+      slots[command].pending = false;
+    }
+
+    TaskHandle_t handle = NULL;
+    if (xTaskCreatePinnedToCore(
+          workerTask, "codec", CODECTASKSTACKSIZE, this,
+          CODECTASKPRIORITY, &handle, CODECTASKCORE) != pdPASS) {
+      // Without worker commands are executed from service(), called by the owner
+      Serial.printf("ERROR: Unable to start codec task\n\r");
+      handle = NULL;
+    }
+    toWorker = handle;
+}
+
+// Queue a command for the codec, a pending command of the same kind is replaced
+void CodecControl::post(int command, uint8_t value) {
+    if ((command < 0) || (command >= NROFCOMMANDS))
+      return;
+
+    uint32_t now = micros();
+    portENTER_CRITICAL(&slotsMux);
+    Slot *toSlot = &slots[command];
+    stats.posted++;
+    if (toSlot->pending) {
+      stats.coalesced++; // keep the time of the first post for the latency
+    } else {
+      toSlot->pending = true;
+      toSlot->postTime = now;
+    }
+    toSlot->value = value;
+    portEXIT_CRITICAL(&slotsMux);
+
+    if (toWorker != NULL) {
+      xTaskNotifyGive((TaskHandle_t) toWorker);
+    }
+}
+
+// Execute all pending commands, returns the nr of commands sent to the codec
+int CodecControl::service() {
+    int executed = 0;
+    for(int command = 0; command < NROFCOMMANDS; command++) {
+      portENTER_CRITICAL(&slotsMux);
+      Slot slot = slots[command];
+      slots[command].pending = false;
+      portEXIT_CRITICAL(&slotsMux);
+
+      if (!slot.pending)
+        continue;
+
+      bool ok = execute(command, slot.value);
+      uint32_t latency = micros() - slot.postTime;
+
+      portENTER_CRITICAL(&slotsMux);
+      stats.executed++;
+      if (!ok)
+        stats.failed++;
+      stats.totalLatency += latency;
+      if (latency > stats.maxLatency)
+        stats.maxLatency = latency;
+      portEXIT_CRITICAL(&slotsMux);
+      executed++;
+    }
+    return executed;
+}
+
+bool CodecControl::execute(int command, uint8_t value) {
+    if (toCodec == NULL)
+      return false;
+
+    switch(command) {
+      case SETVOLUMEHEADPHONE:
+        return toCodec->SetVolumeHeadphone(value);
+      case SETVOLUMESPEAKER:
+        return toCodec->SetVolumeSpeaker(value);
+    }
+    return false;
+}
+
+void CodecControl::workerTask(void *toCodecControl) {
+    CodecControl *toControl = (CodecControl *) toCodecControl;
+    while(1) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      toControl->service();
+    }
+}
+
+void CodecControl::printStats() {
+    uint32_t average = 0;
+    if (stats.executed > 0)
+      average = stats.totalLatency / stats.executed;
+    Serial.printf("Codec p:%lu c:%lu e:%lu f:%lu lat avg:%luus max:%luus\n\r",
+      (unsigned long) stats.posted, (unsigned long) stats.coalesced,
+      (unsigned long) stats.executed, (unsigned long) stats.failed,
+      (unsigned long) average, (unsigned long) stats.maxLatency);
+}
@@ -0,0 +1,50 @@
+/*!
+ *  @file       DelayLine.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "DelayLine.h"
+
+// -----------------------------------------------------------------------------
+// Takes the samples from the arena, returns false when it is too small
+bool DelayLine::begin(Arena *toArena, int newLength) {
+    int bytesPerSample = COMPACTDELAYLINES ? sizeof(int16_t) : sizeof(int32_t);
+    void *toMemory = toArena->allocate(newLength * bytesPerSample);
+    if (toMemory == NULL)
+      return false;
+    toSamples16 = (int16_t *) toMemory;
+    toSamples32 = (int32_t *) toMemory;
+    length = newLength;
+    writeIndex = 0;
+    return true;
+}
+
+void DelayLine::clear() {
+    int bytesPerSample = COMPACTDELAYLINES ? sizeof(int16_t) : sizeof(int32_t);
+    if (length > 0)
+      memset(toSamples32, 0, length * bytesPerSample);
+    writeIndex = 0;
+}
@@ -0,0 +1,238 @@
+/*!
+ *  @file       Effects.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <math.h>
+
+#include "Effects.h"
+#include "Gain.h"
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+static const float CHORUSBASEMS = 10.0;  // delay of the chorus taps at LFO zero
+static const float CHORUSDEPTHMS = 8.0;  // LFO swing at full depth
+static const int32_t MAXFEEDBACK = 0x7000; // Q15, keeps the repeats dying out
+static const float TWOPI = 6.2831853f;
+static const int HEADROOMSHIFT = 2; // a few full scale voices fit in the 16 bit delay lines
+
+// Delay note values in MIDI clocks, 24 per beat:
+// 1/16, 1/8 triplet, 1/8, dotted 1/8, 1/4, dotted 1/4, 1/2
+static const uint8_t DELAYNOTECLOCKS[] = { 6, 8, 12, 18, 24, 36, 48 };
+static const int NROFDELAYNOTES = sizeof(DELAYNOTECLOCKS) / sizeof(DELAYNOTECLOCKS[0]);
+
+// Divides the sample rate by the largest power of two that stays above EFFECTSMINRATE
+int Effects::effectsShift(int sampleRate) {
+    int shift = 0;
+    while ((sampleRate >> (shift + 1)) >= EFFECTSMINRATE)
+      shift++;
+    return shift;
+}
+
+int Effects::chorusLength(int rate) {
+    return (rate * CHORUSMAXMS) / 1000 + 2;
+}
+
+int Effects::delayLength(int rate) {
+    return (int) (((int64_t) rate * DELAYMAXMS) / 1000) + 2;
+}
+
+// Arena size needed by begin() for this sample rate
+size_t Effects::arenaBytes(int sampleRate) {
+    int rate = sampleRate >> effectsShift(sampleRate);
+    size_t bytesPerSample = COMPACTDELAYLINES ? sizeof(int16_t) : sizeof(int32_t);
+    return (chorusLength(rate) + delayLength(rate)) * bytesPerSample + 2 * Arena::ALIGNMENT +
+      Reverb::arenaBytes(rate, REVERBRAMBYTES);
+}
+
+// Takes the delay lines from the arena, without them the effects stay off
+bool Effects::begin(Arena *toArena, int sampleRate) {
+    decimationShift = effectsShift(sampleRate);
+    effectsRate = sampleRate >> decimationShift;
+    if (!chorusLine.begin(toArena, chorusLength(effectsRate)) ||
+        !delayLine.begin(toArena, delayLength(effectsRate)) ||
+        !reverb.begin(toArena, effectsRate, REVERBRAMBYTES))
+      return false;
+
+    chorusLeft = (int32_t) ((CHORUSBASEMS * effectsRate / 1000) * 65536);
+    chorusRight = chorusLeft;
+    updateDelayTarget();
+    delayTime = delayTarget;
+    return true;
+}
+
+void Effects::setParameter(uint8_t parameter, uint8_t value) {
+    if ((chorusLine.getLength() == 0) || (delayLine.getLength() == 0))
+      return; // no memory for the effects
+    bool wasActive = isActive();
+    value &= 0x7f;
+    switch(parameter) {
+      case CHORUSLEVEL:
+        chorusLevel = controllerToGain(value);
+        break;
+      case CHORUSRATE:
+        chorusRateHz = 0.1f + (4.9f * value) / 127;
+        break;
+      case CHORUSDEPTH:
+        chorusDepth = (int32_t) (((value / 127.0f) * CHORUSDEPTHMS * effectsRate / 1000) * 65536);
+        break;
+      case DELAYLEVEL:
+        delayLevel = controllerToGain(value);
+        break;
+      case DELAYFEEDBACK:
+        delayFeedback = (value * MAXFEEDBACK) / 127;
+        break;
+      case DELAYNOTE:
+        if (value < NROFDELAYNOTES) {
+          delayNote = value;
+          updateDelayTarget();
+        }
+        break;
+      case TEMPO:
+        if (value > 0)
+          setBeatMicros(60000000UL / (value * 2));
+        break;
+      case REVERBLEVEL:
+        if ((reverbLevel == 0) && (value > 0))
+          reverb.clear(); // tail left from before it was switched off
+        reverbLevel = controllerToGain(value);
+        break;
+      case REVERBTIME:
+        reverb.setTime(value);
+        break;
+      case REVERBDAMPING:
+        reverb.setDamping(value);
+        break;
+    }
+
+    // Do not play what was left in the delay lines when the effects were switched off
+    if (!wasActive && isActive())
+      clear();
+}
+
+// Switches the bus off without losing the parameters, the tails are dropped
+void Effects::setBypass(bool on) {
+    bool wasActive = isActive();
+    bypassed = on;
+    if (!wasActive && isActive())
+      clear();
+}
+
+void Effects::clear() {
+    chorusLine.clear();
+    delayLine.clear();
+    reverb.clear();
+    lastWetLeft = 0;
+    lastWetRight = 0;
+}
+
+// Tempo for the delay, as from the MIDI clock
+void Effects::setBeatMicros(uint32_t micros) {
+    beatMicros = micros;
+    updateDelayTarget();
+}
+
+// Delay time of the note value at the tempo, limited to the delay line
+void Effects::updateDelayTarget() {
+    int64_t samples = ((int64_t) beatMicros * DELAYNOTECLOCKS[delayNote] * effectsRate) / 24000000;
+    int64_t maxSamples = delayLine.getLength() - 3;
+    if (samples > maxSamples)
+      samples = maxSamples;
+    if (samples < 0)
+      samples = 0;
+    delayTarget = (int32_t) (samples << 16);
+}
+
+// Left holds the mono mix, it becomes the left output and right the right output.
+// Modulation and delay time changes glide across the block.
+void Effects::process(int32_t left[], int32_t right[], int bufferSize) {
+    int factor = 1 << decimationShift;
+    int size = bufferSize >> decimationShift;
+
+    chorusPhase += (TWOPI * chorusRateHz * size) / effectsRate;
+    if (chorusPhase > TWOPI)
+      chorusPhase -= TWOPI;
+    int32_t chorusBase = (int32_t) ((CHORUSBASEMS * effectsRate / 1000) * 65536);
+    int32_t targetLeft = chorusBase + (int32_t) (chorusDepth * sinf(chorusPhase));
+    int32_t targetRight = chorusBase + (int32_t) (chorusDepth * cosf(chorusPhase));
+    int32_t stepLeft = (targetLeft - chorusLeft) / size;
+    int32_t stepRight = (targetRight - chorusRight) / size;
+    int32_t nextDelayTime = delayTime + (delayTarget - delayTime) / 4;
+    int32_t delayStep = (nextDelayTime - delayTime) / size;
+
+    for(int effectsIndex = 0; effectsIndex < size; effectsIndex++) {
+      int first = effectsIndex << decimationShift;
+      int32_t sum = 0;
+      for(int index = first; index < first + factor; index++) {
+        sum += left[index];
+      }
+      int32_t input = sum >> (decimationShift + HEADROOMSHIFT);
+
+      chorusLine.write(input);
+      int32_t chorusOutLeft, chorusOutRight, echo;
+      if (cheapInterpolation) {
+        chorusOutLeft = chorusLine.tap(chorusLeft >> 16);
+        chorusOutRight = chorusLine.tap(chorusRight >> 16);
+        echo = delayLine.tap(delayTime >> 16);
+      } else {
+        chorusOutLeft = chorusLine.read(chorusLeft);
+        chorusOutRight = chorusLine.read(chorusRight);
+        echo = delayLine.read(delayTime);
+      }
+      delayLine.write(input + ((echo * delayFeedback) >> 15));
+
+      int32_t echoOut = (echo * delayLevel) >> (15 - HEADROOMSHIFT);
+      int32_t wetLeft = ((chorusOutLeft * chorusLevel) >> (15 - HEADROOMSHIFT)) + echoOut;
+      int32_t wetRight = ((chorusOutRight * chorusLevel) >> (15 - HEADROOMSHIFT)) + echoOut;
+      if (reverbLevel > 0) {
+        int32_t reverbLeft, reverbRight;
+        reverb.process(input, &reverbLeft, &reverbRight);
+        wetLeft += (reverbLeft * reverbLevel) >> (15 - HEADROOMSHIFT);
+        wetRight += (reverbRight * reverbLevel) >> (15 - HEADROOMSHIFT);
+      }
+
+      // Back to the output rate, interpolated from the previous wet sample
+      if (cheapInterpolation) {
+        for(int index = first; index < first + factor; index++) {
+          right[index] = left[index] + wetRight;
+          left[index] += wetLeft;
+        }
+      } else {
+        for(int step = 1; step <= factor; step++) {
+          int index = first + step - 1;
+          right[index] = left[index] + lastWetRight + (((wetRight - lastWetRight) * step) >> decimationShift);
+          left[index] += lastWetLeft + (((wetLeft - lastWetLeft) * step) >> decimationShift);
+        }
+      }
+      lastWetLeft = wetLeft;
+      lastWetRight = wetRight;
+
+      chorusLeft += stepLeft;
+      chorusRight += stepRight;
+      delayTime += delayStep;
+    }
+    chorusLeft = targetLeft;
+    chorusRight = targetRight;
+    delayTime = nextDelayTime;
+}
@@ -0,0 +1,103 @@
+/*!
+ *  @file       Governor.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+
+#include "Governor.h"
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+static const int HOLDBLOCKS = 16;     // blocks to let a step down take effect
+static const int RESTOREBLOCKS = 256; // blocks under the low threshold before a step up
+static const char *LEVELNAMES[Governor::NROFLEVELS] = {
+  "full quality", "capped polyphony", "no filters", "cheap interpolation", "no effects" };
+
+void Governor::reset() {
+    level = FULLQUALITY;
+    load = 0;
+    holdBlocks = 0;
+    quietBlocks = 0;
+    stats = Stats();
+}
+
+// Render time of the last block, returns true when the level changed
+bool Governor::update(uint32_t renderMicros, uint32_t blockMicros) {
+    if (blockMicros == 0)
+      return false;
+    stats.blocks++;
+    stats.blocksAtLevel[level]++;
+
+    uint32_t percent = (renderMicros * 100) / blockMicros;
+    bool overrun = (renderMicros > blockMicros);
+    if (overrun)
+      stats.overruns++;
+    // Rises fast and falls slowly, a single heavy block counts
+    uint32_t sample = percent << 8;
+    if (sample > load)
+      load += (sample - load) >> 1;
+    else
+      load -= (load - sample) >> 4;
+
+    if (holdBlocks > 0)
+      holdBlocks--;
+    if ((overrun || (getLoad() > GOVERNORHIGHPERCENT)) && (holdBlocks == 0) && (level < NOEFFECTS)) {
+      changeLevel(level + 1);
+      holdBlocks = HOLDBLOCKS;
+      return true;
+    }
+
+    if (getLoad() < GOVERNORLOWPERCENT)
+      quietBlocks++;
+    else
+      quietBlocks = 0;
+    if ((quietBlocks >= RESTOREBLOCKS) && (level > FULLQUALITY)) {
+      changeLevel(level - 1);
+      return true;
+    }
+    return false;
+}
+
+void Governor::changeLevel(int newLevel) {
+    if (newLevel > level)
+      stats.stepsDown++;
+    else
+      stats.stepsUp++;
+    level = newLevel;
+    stats.entered[level]++;
+    stats.lastChangeBlock = stats.blocks;
+    quietBlocks = 0;
+}
+
+void Governor::printStats() {
+    Serial.printf("Governor level:%d (%s) load:%lu%% down:%lu up:%lu overruns:%lu last change:%lu blocks ago\n\r",
+      level, LEVELNAMES[level], (unsigned long) getLoad(),
+      (unsigned long) stats.stepsDown, (unsigned long) stats.stepsUp, (unsigned long) stats.overruns,
+      (unsigned long) (stats.blocks - stats.lastChangeBlock));
+    for(int index = 0; index < NROFLEVELS; index++) {
+      Serial.printf("  %-20s entered:%lu blocks:%lu\n\r", LEVELNAMES[index],
+        (unsigned long) stats.entered[index], (unsigned long) stats.blocksAtLevel[index]);
+    }
+}
@@ -0,0 +1,103 @@
+/*!
+ *  @file       LatencyTrace.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdio.h>
+
+#include "LatencyTrace.h"
+
+// -----------------------------------------------------------------------------
+static const char *STAGENAMES[LatencyTrace::NROFSTAGES] = {
+  "byte->parse", "parse->voice", "voice->output", "byte->output" };
+
+const char *LatencyTrace::getStageName(int stage) {
+    return STAGENAMES[stage];
+}
+
+void LatencyTrace::reset() {
+    for(int stage = 0; stage < NROFSTAGES; stage++) {
+      histograms[stage] = Histogram();
+    }
+}
+
+// Stages of one note, a stage is skipped when one of its points is missing
+void LatencyTrace::record(const Times &times) {
+    if ((times.byteMicros != 0) && (times.parseMicros != 0))
+      recordStage(BYTETOPARSE, times.parseMicros - times.byteMicros);
+    if ((times.parseMicros != 0) && (times.voiceMicros != 0))
+      recordStage(PARSETOVOICE, times.voiceMicros - times.parseMicros);
+    if ((times.voiceMicros != 0) && (times.outputMicros != 0))
+      recordStage(VOICETOOUTPUT, times.outputMicros - times.voiceMicros);
+    if ((times.byteMicros != 0) && (times.outputMicros != 0))
+      recordStage(BYTETOOUTPUT, times.outputMicros - times.byteMicros);
+}
+
+void LatencyTrace::recordStage(int stage, uint32_t micros) {
+    Histogram *toHistogram = &histograms[stage];
+    int bucket = 0;
+    while ((bucket < NROFBUCKETS - 1) && ((micros >> bucket) != 0))
+      bucket++;
+    toHistogram->counts[bucket]++;
+    toHistogram->notes++;
+    toHistogram->totalMicros += micros;
+    if (micros > toHistogram->maxMicros)
+      toHistogram->maxMicros = micros;
+}
+
+// Upper bound of the bucket that holds the percentile, in micros
+uint32_t LatencyTrace::getPercentile(int stage, int percent) const {
+    const Histogram *toHistogram = &histograms[stage];
+    if (toHistogram->notes == 0)
+      return 0;
+    uint32_t wanted = (uint32_t) (((uint64_t) toHistogram->notes * percent + 99) / 100);
+    uint32_t seen = 0;
+    for(int bucket = 0; bucket < NROFBUCKETS; bucket++) {
+      seen += toHistogram->counts[bucket];
+      if (seen >= wanted)
+        return (bucket == NROFBUCKETS - 1) ? toHistogram->maxMicros : (1UL << bucket);
+    }
+    return toHistogram->maxMicros;
+}
+
+// One line: count, average, percentiles, maximum and the filled buckets by upper bound
+int LatencyTrace::format(int stage, char *text, int size) const {
+    const Histogram *toHistogram = &histograms[stage];
+    uint32_t average = (toHistogram->notes > 0) ? (uint32_t) (toHistogram->totalMicros / toHistogram->notes) : 0;
+    int length = snprintf(text, size, "%-13s n:%lu avg:%luus p50<%luus p99<%luus max:%luus",
+      STAGENAMES[stage], (unsigned long) toHistogram->notes, (unsigned long) average,
+      (unsigned long) getPercentile(stage, 50), (unsigned long) getPercentile(stage, 99),
+      (unsigned long) toHistogram->maxMicros);
+    for(int bucket = 0; bucket < NROFBUCKETS; bucket++) {
+      if ((toHistogram->counts[bucket] == 0) || (length >= size))
+        continue;
+      if (bucket == NROFBUCKETS - 1)
+        length += snprintf(text + length, size - length, " >=%lu:%lu",
+          (unsigned long) (1UL << (bucket - 1)), (unsigned long) toHistogram->counts[bucket]);
+      else
+        length += snprintf(text + length, size - length, " <%lu:%lu",
+          (unsigned long) (1UL << bucket), (unsigned long) toHistogram->counts[bucket]);
+    }
+    return length;
+}
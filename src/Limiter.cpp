@@ -0,0 +1,110 @@
+/*!
+ *  @file       Limiter.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+
+#include "Limiter.h"
+#include "Gain.h"
+
+// -----------------------------------------------------------------------------
+void Limiter::begin(int sampleRate) {
+    releaseStep = ((int64_t) UNITYGAIN * BUFFERSIZE * 1000) / ((int64_t) LIMITERRELEASEMS * sampleRate);
+    if (releaseStep < 1)
+      releaseStep = 1;
+}
+
+// Gain that brings a block peak down to the threshold, with a soft knee of
+// LIMITERKNEEDB around it. Once per block, so float is cheap enough.
+int32_t Limiter::targetGain(int32_t peak) {
+    if (peak <= 0)
+      return UNITYGAIN;
+    float overDb = 20.0f * log10f((float) peak / LIMITERTHRESHOLD);
+    if (overDb <= -LIMITERKNEEDB / 2)
+      return UNITYGAIN;
+    float reductionDb;
+    if (overDb < LIMITERKNEEDB / 2) {
+      float intoKnee = overDb + LIMITERKNEEDB / 2;
+      reductionDb = -(intoKnee * intoKnee) / (2 * LIMITERKNEEDB);
+    } else {
+      reductionDb = -overDb;
+    }
+    return (int32_t) (powf(10.0f, reductionDb / 20.0f) * UNITYGAIN);
+}
+
+// Takes the new block and writes the block before it, limited and saturated,
+// in the stereo output format. Left and right may be the same mono buffer.
+// Returns the nr of samples written, the size of the block before.
+int Limiter::process(const int32_t left[], const int32_t right[], uint32_t out[], int bufferSize) {
+    int32_t peak = 0;
+    for(int index = 0; index < bufferSize; index++) {
+      int32_t leftLevel = abs(left[index]);
+      int32_t rightLevel = abs(right[index]);
+      if (leftLevel > peak)
+        peak = leftLevel;
+      if (rightLevel > peak)
+        peak = rightLevel;
+    }
+    int32_t newTarget = targetGain(peak);
+
+    // Both the delayed and the new block must fit at the end of the ramp
+    int32_t endGain = (newTarget < delayedTarget) ? newTarget : delayedTarget;
+    int outSize = delayedSize;
+    int32_t release = (releaseStep * outSize) / BUFFERSIZE;
+    if (release < 1)
+      release = 1;
+    if (endGain > gain + release)
+      endGain = gain + release;
+
+    SmoothedGain ramp;
+    ramp.set(gain);
+    ramp.setTarget(endGain);
+    ramp.beginBlock(outSize);
+    for(int index = 0; index < outSize; index++) {
+      int32_t sampleGain = ramp.next();
+      // The one conversion to 16 bits, saturation only catches rounding
+      uint32_t leftSample = (uint16_t) saturate16(((int64_t) delayedLeft[index] * sampleGain) >> 15);
+      uint32_t rightSample = (uint16_t) saturate16(((int64_t) delayedRight[index] * sampleGain) >> 15);
+      out[index] = (leftSample << 16) | rightSample;
+    }
+    memcpy(delayedLeft, left, bufferSize * sizeof(int32_t));
+    memcpy(delayedRight, right, bufferSize * sizeof(int32_t));
+    delayedSize = bufferSize;
+
+    if ((gain < UNITYGAIN) || (endGain < UNITYGAIN))
+      limitedBlocks++;
+    if (endGain < minGain)
+      minGain = endGain;
+    gain = endGain;
+    delayedTarget = newTarget;
+    return outSize;
+}
+
+void Limiter::printStats() {
+    Serial.printf("Limiter blocks:%lu gain now:%ld%% min:%ld%%\n\r",
+      (unsigned long) limitedBlocks, (long) ((gain * 100) >> 15), (long) ((minGain * 100) >> 15));
+}
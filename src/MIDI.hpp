@@ -42,6 +42,10 @@ inline MidiInterface<SerialPort, Settings>::MidiInterface(SerialPort& inSerial)
     , mCurrentNrpnNumber(0xffff)
     , mThruActivated(true)
     , mThruFilterMode(Thru::Full)
+    , mTimestampClock(0)
+    , mPendingByteMicros(0)
+    , mByteMicros(0)
+    , mParseMicros(0)
 {
     mNoteOffCallback                = 0;
     mNoteOnCallback                 = 0;
@@ -655,6 +659,12 @@ inline bool MidiInterface<SerialPort, Settings>::read(Channel inChannel)
     if (!parse())
         return false;
 
+    if (mTimestampClock != 0)
+    {
+        mByteMicros  = mPendingByteMicros;
+        mParseMicros = mTimestampClock();
+    }
+
     handleNullVelocityNoteOnAsNoteOff();
     const bool channelMatch = inputFilter(inChannel);
 
@@ -707,6 +717,11 @@ bool MidiInterface<SerialPort, Settings>::parse()
         // Start a new pending message
         mPendingMessage[0] = extracted;
 
+        // Time of the first byte, as seen here. It may have waited in the
+        // UART buffer since the previous call.
+        if (mTimestampClock != 0)
+            mPendingByteMicros = mTimestampClock();
+
         // Check for running status first
         if (isChannelMessage(getTypeFromStatusByte(mRunningStatus_RX)))
         {
@@ -1084,6 +1099,35 @@ inline void MidiInterface<SerialPort, Settings>::setInputChannel(Channel inChann
 
 // -----------------------------------------------------------------------------
 
+/*! \brief Set the clock used to time stamp incoming messages.
+ \param fptr Function returning a free running microsecond count, 0 disables
+ the time stamps.
+ */
+template<class SerialPort, class Settings>
+inline void MidiInterface<SerialPort, Settings>::setTimestampClock(uint32_t (*fptr)(void))
+{
+    mTimestampClock = fptr;
+}
+
+/*! \brief Time the parser saw the first byte of the last message read.
+ Only valid while a callback runs or right after read() returned true.
+ */
+template<class SerialPort, class Settings>
+inline uint32_t MidiInterface<SerialPort, Settings>::getByteMicros() const
+{
+    return mByteMicros;
+}
+
+/*! \brief Time the last message read was complete.
+ */
+template<class SerialPort, class Settings>
+inline uint32_t MidiInterface<SerialPort, Settings>::getParseMicros() const
+{
+    return mParseMicros;
+}
+
+// -----------------------------------------------------------------------------
+
 /*! \brief Extract an enumerated MIDI type from a status byte.
 
  This is a utility static method, used internally,
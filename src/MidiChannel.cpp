@@ -0,0 +1,218 @@
+/*!
+ *  @file       MidiChannel.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+
+#include "MidiChannel.h"
+#include "VelocityCurve.h"
+#include "PolySynth.h"
+
+// -----------------------------------------------------------------------------
+static const uint32_t MAXENVELOPEMS = 4000;
+
+int32_t envelopeStep(uint16_t ms) {
+    if (ms == 0)
+      return UNITYGAIN; // complete in one block
+    int32_t step = ((int64_t) UNITYGAIN * BUFFERSIZE * 1000) / ((int64_t) ms * SAMPLERATE);
+    if (step < 1)
+      step = 1;
+    return step;
+}
+
+uint16_t controllerToMs(uint8_t value) {
+    if (value > 127)
+      value = 127;
+    return ((uint32_t) value * value * MAXENVELOPEMS) / (127 * 127);
+}
+
+void MidiChannel::begin(uint8_t defaultStyle) {
+    style = defaultStyle;
+    attackMs = 0;
+    releaseMs = 0;
+    bendRange = 2;
+    bendRangeCents = 0;
+    coarseTune = 0;
+    fineTune = 0;
+    fineTuneData = 0x2000;
+    priority = 64;
+    velocityCurve = VelocityCurves::LINEARCURVE;
+    filterCutoff = 127;
+    filterResonance = 0;
+    filterEnvelope = 64;
+    filterKeyTrack = 0;
+    volume = 100;
+    expression = 127;
+    modulation = 0;
+    pitchBend = 0;
+    rpn = RPNNULL;
+    sustainPedal = false;
+    sostenutoPedal = false;
+    keysDown.clearAll();
+    sustained.clearAll();
+    sostenutoKeys.clearAll();
+    pitchFactor = 0x10000;
+    activeVoices = 0;
+    updateGain();
+    updateEnvelope();
+}
+
+// Selects the waveform of the channel, returns false for unknown programs
+bool MidiChannel::programChange(uint8_t number) {
+    if (number == 0) {
+      // Use sinus wave sounds (piano)
+      style = PolySynth::SINUSSTYLE;
+    } else
+    if (number == 18) {
+      // Use triangle wave sounds (organ)
+      style = PolySynth::TRIANGLESTYLE;
+    } else
+    if (number == 36) {
+      // Use square wave sounds (computer)
+      style = PolySynth::SQUARESTYLE;
+    } else {
+      return false;
+    }
+    return true;
+}
+
+// Returns false for controllers the channel does not use
+bool MidiChannel::controlChange(uint8_t number, uint8_t value) {
+    switch(number) {
+      case CCVOLUME:
+        volume = value;
+        updateGain();
+        break;
+      case CCEXPRESSION:
+        expression = value;
+        updateGain();
+        break;
+      case CCRELEASETIME:
+        releaseMs = controllerToMs(value);
+        updateEnvelope();
+        break;
+      case CCATTACKTIME:
+        attackMs = controllerToMs(value);
+        updateEnvelope();
+        break;
+      case CCCUTOFF:
+        filterCutoff = value;
+        break;
+      case CCRESONANCE:
+        filterResonance = value;
+        break;
+      case CCFILTERENVELOPE:
+        filterEnvelope = value;
+        break;
+      case CCFILTERKEYTRACK:
+        filterKeyTrack = value;
+        break;
+      case CCMODULATION:
+        modulation = value;
+        break;
+      case CCRPNMSB:
+        rpn = (rpn & 0x7f) | ((uint16_t) value << 7);
+        break;
+      case CCRPNLSB:
+        rpn = (rpn & 0x3f80) | value;
+        break;
+      case CCNRPNMSB:
+      case CCNRPNLSB:
+        rpn = RPNNULL; // data entry is for a non registered parameter
+        break;
+      case CCDATAENTRY:
+        dataEntry(value, true);
+        break;
+      case CCDATAENTRYLSB:
+        dataEntry(value, false);
+        break;
+      default:
+        return false;
+    }
+    return true;
+}
+
+// Data entry for the selected registered parameter
+void MidiChannel::dataEntry(uint8_t value, bool msb) {
+    switch(rpn) {
+      case RPNBENDRANGE:
+        if (msb)
+          bendRange = (value > MAXBENDRANGE) ? MAXBENDRANGE : value;
+        else
+          bendRangeCents = (value < 100) ? value : 99;
+        break;
+      case RPNFINETUNE:
+        // 14 bits, 0x2000 is in tune, range is -100..+100 cents
+        if (msb)
+          fineTuneData = (fineTuneData & 0x7f) | ((uint16_t) value << 7);
+        else
+          fineTuneData = (fineTuneData & 0x3f80) | value;
+        fineTune = (((int32_t) fineTuneData - 0x2000) * 100) / 0x2000;
+        break;
+      case RPNCOARSETUNE:
+        if (msb) {
+          int semitones = (int) value - 64;
+          if (semitones > MAXCOARSETUNE)
+            semitones = MAXCOARSETUNE;
+          if (semitones < -MAXCOARSETUNE)
+            semitones = -MAXCOARSETUNE;
+          coarseTune = semitones;
+        }
+        break;
+    }
+}
+
+void MidiChannel::pitchBendChange(int bend) {
+    pitchBend = bend;
+}
+
+// Frequency factor for the next block, lfo is the vibrato LFO value -1..1
+void MidiChannel::updatePitchFactor(float lfo) {
+    float semitones = coarseTune + fineTune / 100.0f;
+    semitones += (pitchBend * (bendRange + bendRangeCents / 100.0f)) / 8192.0f;
+    semitones += lfo * (modulation / 127.0f) * VIBRATODEPTHSEMITONES;
+    // Keeps the Q16 factor far inside int32, the wave generator limits the
+    // increment that results from it
+    if (semitones > MAXPITCHSEMITONES)
+      semitones = MAXPITCHSEMITONES;
+    if (semitones < -MAXPITCHSEMITONES)
+      semitones = -MAXPITCHSEMITONES;
+    pitchFactor = (int32_t) (exp2f(semitones / 12.0f) * 65536.0f);
+}
+
+// Phase increment of a note with the pitch factor of this block, saturated
+int32_t MidiChannel::pitchIncrement(int32_t noteIncrement) const {
+    int64_t increment = ((int64_t) noteIncrement * pitchFactor) >> 16;
+    return (increment > INT32_MAX) ? INT32_MAX : (int32_t) increment;
+}
+
+void MidiChannel::updateGain() {
+    gain = (controllerToGain(volume) * controllerToGain(expression)) >> 15;
+}
+
+void MidiChannel::updateEnvelope() {
+    attackStep = envelopeStep(attackMs);
+    releaseStep = (releaseMs == 0) ? 0 : envelopeStep(releaseMs);
+}
@@ -0,0 +1,407 @@
+/*!
+ *  @file       MidiFilePlayer.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "MidiFilePlayer.h"
+
+// -----------------------------------------------------------------------------
+static const uint32_t DEFAULTTEMPO = 500000; // 120 bpm
+
+static uint32_t readBigEndian(const uint8_t *toBytes, int size) {
+    uint32_t value = 0;
+    for(int index = 0; index < size; index++) {
+      value = (value << 8) | toBytes[index];
+    }
+    return value;
+}
+
+// Finds the tracks, the file may be followed by anything, like erased flash
+bool MidiFilePlayer::open(const uint8_t *toFile, size_t size) {
+    close();
+    if ((size < 14) || (memcmp(toFile, "MThd", 4) != 0))
+      return false;
+    uint32_t headerLength = readBigEndian(&toFile[4], 4);
+    uint16_t format = readBigEndian(&toFile[8], 2);
+    uint16_t nrOfChunks = readBigEndian(&toFile[10], 2);
+    division = readBigEndian(&toFile[12], 2);
+    if ((headerLength < 6) || (format > 1) || (division == 0) || ((division & 0x00ff) == 0 && (division & 0x8000)))
+      return false;
+
+    size_t position = 8 + headerLength;
+    int found = 0;
+    while ((found < nrOfChunks) && (position + 8 <= size)) {
+      uint32_t length = readBigEndian(&toFile[position + 4], 4);
+      const uint8_t *toData = &toFile[position + 8];
+      if (length > size - position - 8) {
+        length = size - position - 8;
+        stats.errors++;
+      }
+      if (memcmp(&toFile[position], "MTrk", 4) == 0) {
+        found++;
+        if (nrOfTracks < MAXTRACKS) {
+          Track *toTrack = &tracks[nrOfTracks++];
+          toTrack->toStart = toData;
+          toTrack->toEnd = toData + length;
+        } else {
+          stats.errors++;
+        }
+      }
+      position += 8 + length;
+    }
+    return nrOfTracks > 0;
+}
+
+void MidiFilePlayer::close() {
+    nrOfTracks = 0;
+    heapSize = 0;
+    playing = false;
+    stopping = false;
+    headerSize = 0;
+    dataSize = 0;
+    sent = 0;
+    memset(sounding, 0, sizeof(sounding));
+    memset(&stats, 0, sizeof(stats));
+}
+
+void MidiFilePlayer::start(uint32_t nowMicros, bool loop) {
+    if (nrOfTracks == 0)
+      return;
+    rewind();
+    playing = true;
+    looping = loop;
+    stopping = false;
+    lastMicros = nowMicros;
+    elapsedMicros = 0;
+    passMicros = 0;
+    headerSize = 0;
+    dataSize = 0;
+    sent = 0;
+}
+
+// Stops at the next message, the notes that are still on get a note off
+void MidiFilePlayer::stop() {
+    if (!playing)
+      return;
+    playing = false;
+    stopping = true;
+}
+
+void MidiFilePlayer::update(uint32_t nowMicros) {
+    if (!playing)
+      return;
+    elapsedMicros += nowMicros - lastMicros;
+    lastMicros = nowMicros;
+}
+
+// Bytes of the message that is due, 0 when the next one is not
+int MidiFilePlayer::available() {
+    uint32_t size = headerSize + dataSize;
+    if ((sent == size) && !nextMessage())
+      return 0;
+    return headerSize + dataSize - sent;
+}
+
+int MidiFilePlayer::read() {
+    if (available() == 0)
+      return -1;
+    uint32_t index = sent++;
+    if (index < (uint32_t) headerSize)
+      return header[index];
+    return toData[index - headerSize];
+}
+
+// -----------------------------------------------------------------------------
+
+void MidiFilePlayer::rewind() {
+    heapSize = 0;
+    tempo = DEFAULTTEMPO;
+    segmentTick = 0;
+    segmentMicros = 0;
+    lastTick = 0;
+    for(int index = 0; index < nrOfTracks; index++) {
+      Track *toTrack = &tracks[index];
+      toTrack->toNext = toTrack->toStart;
+      toTrack->tick = 0;
+      toTrack->runningStatus = 0;
+      toTrack->ended = false;
+      readDelta(toTrack);
+      if (!toTrack->ended)
+        pushTrack(index);
+    }
+}
+
+// Time of a tick from the start of the pass, with the tempo in effect
+uint64_t MidiFilePlayer::tickMicros(uint32_t tick) const {
+    if (division & 0x8000) {
+      // SMPTE: frames per second, 29 means 29.97, and ticks per frame
+      int framesPerSecond = -(int8_t) (division >> 8);
+      uint64_t ticksPerHundredSeconds = (uint64_t) (division & 0xff) *
+        ((framesPerSecond == 29) ? 2997 : framesPerSecond * 100);
+      return ((uint64_t) tick * 100000000ULL) / ticksPerHundredSeconds;
+    }
+    return segmentMicros + ((uint64_t) (tick - segmentTick) * tempo) / division;
+}
+
+// Next message to pass on, reads events until one is found or the next is not due
+bool MidiFilePlayer::nextMessage() {
+    headerSize = 0;
+    toData = NULL;
+    dataSize = 0;
+    sent = 0;
+    if (stopping)
+      return nextNoteOff();
+
+    while (playing) {
+      if (heapSize == 0) {
+        // End of the file, notes it left on are stopped
+        if (!looping) {
+          playing = false;
+          stopping = true;
+          return nextNoteOff();
+        }
+        passMicros += tickMicros(lastTick);
+        stats.loops++;
+        rewind();
+        if (heapSize == 0) {
+          playing = false;
+          return false;
+        }
+      }
+      Track *toTrack = &tracks[heap[0]];
+      if (passMicros + tickMicros(toTrack->tick) > elapsedMicros)
+        return false;
+
+      int track = popTrack();
+      lastTick = toTrack->tick;
+      bool message = readEvent(toTrack);
+      readDelta(toTrack);
+      if (!toTrack->ended)
+        pushTrack(track);
+      if (message) {
+        stats.events++;
+        return true;
+      }
+    }
+    return false;
+}
+
+// Reads the event at the read position of the track, returns true when it
+// is a message to pass on
+bool MidiFilePlayer::readEvent(Track *toTrack) {
+    const uint8_t *toNext = toTrack->toNext;
+    if (toNext >= toTrack->toEnd) {
+      toTrack->ended = true;
+      return false;
+    }
+
+    uint8_t status = *toNext;
+    if (status < 0x80) {
+      // Running status, the data bytes start here
+      status = toTrack->runningStatus;
+      if (status == 0) {
+        stats.errors++;
+        toTrack->ended = true;
+        return false;
+      }
+    } else {
+      toNext++;
+    }
+
+    if (status < 0xF0) {
+      int size = (((status & 0xF0) == 0xC0) || ((status & 0xF0) == 0xD0)) ? 1 : 2;
+      if (toTrack->toEnd - toNext < size) {
+        stats.errors++;
+        toTrack->ended = true;
+        return false;
+      }
+      toTrack->runningStatus = status;
+      header[0] = status;
+      memcpy(&header[1], toNext, size);
+      headerSize = 1 + size;
+      toTrack->toNext = toNext + size;
+
+      // Remember the notes that sound, for the note offs of stop()
+      int channel = status & 0x0f;
+      uint8_t pitch = header[1] & 0x7f;
+      uint32_t bit = 1UL << (pitch & 31);
+      if (((status & 0xF0) == 0x90) && (header[2] != 0))
+        sounding[channel][pitch >> 5] |= bit;
+      else if (((status & 0xF0) == 0x80) || ((status & 0xF0) == 0x90))
+        sounding[channel][pitch >> 5] &= ~bit;
+      return true;
+    }
+
+    // SysEx and meta events cancel the running status
+    toTrack->runningStatus = 0;
+    uint8_t metaType = 0;
+    if (status == 0xFF) {
+      if (toNext >= toTrack->toEnd) {
+        toTrack->ended = true;
+        return false;
+      }
+      metaType = *toNext++;
+    }
+    toTrack->toNext = toNext;
+    uint32_t length;
+    if (!readVariable(toTrack, &length) || (length > (uint32_t) (toTrack->toEnd - toTrack->toNext))) {
+      stats.errors++;
+      toTrack->ended = true;
+      return false;
+    }
+    const uint8_t *toEventData = toTrack->toNext;
+    toTrack->toNext += length;
+
+    if (status == 0xF0) {
+      // SysEx, the F0 is not in the data
+      header[0] = 0xF0;
+      headerSize = 1;
+      toData = toEventData;
+      dataSize = length;
+      return true;
+    }
+    if (status == 0xF7) {
+      // Escape, the bytes are sent as they are
+      toData = toEventData;
+      dataSize = length;
+      return length > 0;
+    }
+    if (status == 0xFF) {
+      if ((metaType == 0x51) && (length == 3)) {
+        // Tempo, the time of the ticks after it follows the new tempo
+        segmentMicros = tickMicros(toTrack->tick);
+        segmentTick = toTrack->tick;
+        tempo = readBigEndian(toEventData, 3);
+        stats.tempoChanges++;
+      } else
+      if (metaType == 0x2F) {
+        toTrack->ended = true; // end of track
+      }
+      return false;
+    }
+    stats.errors++; // system common and real time messages do not belong in a file
+    toTrack->ended = true;
+    return false;
+}
+
+// Variable length quantity, 7 bits per byte, at most 4 bytes
+bool MidiFilePlayer::readVariable(Track *toTrack, uint32_t *toValue) {
+    uint32_t value = 0;
+    for(int index = 0; index < 4; index++) {
+      if (toTrack->toNext >= toTrack->toEnd)
+        return false;
+      uint8_t part = *toTrack->toNext++;
+      value = (value << 7) | (part & 0x7f);
+      if ((part & 0x80) == 0) {
+        *toValue = value;
+        return true;
+      }
+    }
+    return false;
+}
+
+// Delta time before the next event of the track
+void MidiFilePlayer::readDelta(Track *toTrack) {
+    if (toTrack->ended)
+      return;
+    if (toTrack->toNext >= toTrack->toEnd) {
+      toTrack->ended = true;
+      return;
+    }
+    uint32_t delta;
+    if (!readVariable(toTrack, &delta)) {
+      stats.errors++;
+      toTrack->ended = true;
+      return;
+    }
+    toTrack->tick += delta;
+}
+
+// Earlier tick first, the lower track on the same tick, so the tempo
+// track of a type 1 file goes before the notes
+bool MidiFilePlayer::isBefore(int first, int second) const {
+    if (tracks[first].tick != tracks[second].tick)
+      return tracks[first].tick < tracks[second].tick;
+    return first < second;
+}
+
+void MidiFilePlayer::pushTrack(int track) {
+    int index = heapSize++;
+    heap[index] = (uint8_t) track;
+    while (index > 0) {
+      int parent = (index - 1) / 2;
+      if (!isBefore(heap[index], heap[parent]))
+        break;
+      uint8_t swap = heap[parent];
+      heap[parent] = heap[index];
+      heap[index] = swap;
+      index = parent;
+    }
+}
+
+int MidiFilePlayer::popTrack() {
+    int track = heap[0];
+    heap[0] = heap[--heapSize];
+    int index = 0;
+    while (1) {
+      int smallest = index;
+      int left = 2 * index + 1;
+      int right = left + 1;
+      if ((left < heapSize) && isBefore(heap[left], heap[smallest]))
+        smallest = left;
+      if ((right < heapSize) && isBefore(heap[right], heap[smallest]))
+        smallest = right;
+      if (smallest == index)
+        break;
+      uint8_t swap = heap[smallest];
+      heap[smallest] = heap[index];
+      heap[index] = swap;
+      index = smallest;
+    }
+    return track;
+}
+
+// Note off for the next note the file left on, false when all are off
+bool MidiFilePlayer::nextNoteOff() {
+    for(int channel = 0; channel < 16; channel++) {
+      for(int word = 0; word < 4; word++) {
+        uint32_t bits = sounding[channel][word];
+        if (bits == 0)
+          continue;
+        int bit = 0;
+        while ((bits & (1UL << bit)) == 0)
+          bit++;
+        sounding[channel][word] &= ~(1UL << bit);
+        header[0] = (uint8_t) (0x80 | channel);
+        header[1] = (uint8_t) (word * 32 + bit);
+        header[2] = 0;
+        headerSize = 3;
+        return true;
+      }
+    }
+    stopping = false;
+    return false;
+}
@@ -0,0 +1,139 @@
+/*!
+ *  @file       MidiRecorder.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "MidiRecorder.h"
+
+// -----------------------------------------------------------------------------
+bool MidiRecorder::begin(int newNrOfEntries) {
+    int entries = 1;
+    while (entries < newNrOfEntries)
+      entries <<= 1;
+    toEntries = (Entry *) calloc(entries, sizeof(Entry));
+    if (toEntries == NULL) {
+      nrOfEntries = 0;
+      return false;
+    }
+    nrOfEntries = entries;
+    writeCount = 0;
+    full = false;
+    messages = 0;
+    return true;
+}
+
+// Stores a message of any length, three bytes per entry
+void MidiRecorder::record(uint32_t sample, const uint8_t *message, int size) {
+    if (!recording || (nrOfEntries == 0) || (size <= 0))
+      return;
+    for(int offset = 0; offset < size; offset += 3) {
+      Entry *toEntry = &toEntries[writeCount & (nrOfEntries - 1)];
+      int part = size - offset;
+      if (part > 3)
+        part = 3;
+      toEntry->sample = sample;
+      toEntry->size = (uint8_t) part;
+      if (offset > 0)
+        toEntry->size |= CONTINUED;
+      for(int index = 0; index < part; index++) {
+        toEntry->data[index] = message[offset + index];
+      }
+      writeCount++;
+      if (writeCount == (uint32_t) nrOfEntries)
+        full = true;
+    }
+    messages++;
+}
+
+// Channel and system common messages, the size follows from the status
+void MidiRecorder::record(uint32_t sample, uint8_t status, uint8_t data1, uint8_t data2) {
+    uint8_t message[3] = { status, data1, data2 };
+    int size = messageSize(status);
+    if (size > 0)
+      record(sample, message, size);
+}
+
+uint32_t MidiRecorder::getFirst() const {
+    if (full)
+      return writeCount - nrOfEntries;
+    return 0;
+}
+
+// Entries lost because the ring was full
+uint32_t MidiRecorder::getOverwritten() const {
+    return getFirst();
+}
+
+bool MidiRecorder::format(uint32_t *toPosition, char *text, int size) const {
+    uint32_t position = *toPosition;
+    // Positions wrap with the write count, compare them by their distance
+    if ((uint32_t) (writeCount - position) > (uint32_t) (writeCount - getFirst()))
+      position = getFirst();
+    // Rest of a message whose start was overwritten
+    while ((position != writeCount) && (toEntries[position & (nrOfEntries - 1)].size & CONTINUED))
+      position++;
+    if (position == writeCount) {
+      *toPosition = position;
+      return false;
+    }
+
+    const Entry *toEntry = &toEntries[position & (nrOfEntries - 1)];
+    int length = snprintf(text, size, "%lu", (unsigned long) toEntry->sample);
+    do {
+      for(int index = 0; index < (toEntry->size & SIZEMASK); index++) {
+        if (length < size)
+          length += snprintf(&text[length], size - length, " %02x", toEntry->data[index]);
+      }
+      position++;
+      toEntry = &toEntries[position & (nrOfEntries - 1)];
+    } while ((position != writeCount) && (toEntry->size & CONTINUED));
+    *toPosition = position;
+    return true;
+}
+
+// Bytes of a message with this status, 0 for SysEx whose length varies
+int MidiRecorder::messageSize(uint8_t status) {
+    if (status < 0x80)
+      return 0;
+    if (status < 0xF0) {
+      uint8_t type = status & 0xF0;
+      if ((type == 0xC0) || (type == 0xD0))
+        return 2; // program change, channel pressure
+      return 3;
+    }
+    switch(status) {
+      case 0xF1: // time code quarter frame
+      case 0xF3: // song select
+        return 2;
+      case 0xF2: // song position
+        return 3;
+      case 0xF0: // SysEx
+      case 0xF7:
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,113 @@
+/*!
+ *  @file       OutputPipeline.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <stdlib.h>
+
+#include "OutputPipeline.h"
+
+// -----------------------------------------------------------------------------
+bool OutputPipeline::begin(int newDepth, int newBlockSize) {
+    if (newDepth < 1)
+      newDepth = 1;
+    if (newDepth > MAXDEPTH)
+      newDepth = MAXDEPTH;
+    // Only depth blocks are filled, the ring is rounded up so that a count
+    // maps to its block with a mask
+    int slots = 1;
+    while (slots < newDepth)
+      slots <<= 1;
+    toBlocks = (uint32_t *) calloc(slots * newBlockSize, sizeof(uint32_t));
+    if (toBlocks == NULL) {
+      depth = 0;
+      return false;
+    }
+    depth = newDepth;
+    slotMask = slots - 1;
+    blockSize = newBlockSize;
+    writeCount.store(0);
+    readCount.store(0);
+    resetStats();
+    return true;
+}
+
+// Free block to render into, NULL when the output is depth blocks behind
+uint32_t *OutputPipeline::getWriteBlock() {
+    uint32_t write = writeCount.load(std::memory_order_relaxed);
+    if ((int) (write - readCount.load(std::memory_order_acquire)) >= depth) {
+      stats.fullWaits++;
+      return NULL;
+    }
+    return &toBlocks[(write & slotMask) * blockSize];
+}
+
+// Hands the block from getWriteBlock() to the output, with size samples in it
+void OutputPipeline::commitWrite(int size) {
+    uint32_t write = writeCount.load(std::memory_order_relaxed);
+    sizes[write & slotMask] = size;
+    writeCount.store(write + 1, std::memory_order_release);
+    stats.written++;
+}
+
+// Samples waiting for the output, only valid on the render side
+int OutputPipeline::getQueuedSamples() const {
+    uint32_t write = writeCount.load(std::memory_order_relaxed);
+    int queued = 0;
+    for(uint32_t count = readCount.load(std::memory_order_acquire); count != write; count++) {
+      queued += sizes[count & slotMask];
+    }
+    return queued;
+}
+
+// Oldest rendered block and its size, NULL when the render has not finished one
+uint32_t *OutputPipeline::getReadBlock(int *toSize) {
+    uint32_t read = readCount.load(std::memory_order_relaxed);
+    int fill = (int) (writeCount.load(std::memory_order_acquire) - read);
+    if (fill == 0)
+      return NULL;
+    if (fill < stats.minFill)
+      stats.minFill = fill;
+    if (fill > stats.maxFill)
+      stats.maxFill = fill;
+    *toSize = sizes[read & slotMask];
+    return &toBlocks[(read & slotMask) * blockSize];
+}
+
+// Gives the block from getReadBlock() back to the render
+void OutputPipeline::commitRead() {
+    readCount.store(readCount.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    stats.sent++;
+}
+
+// Worst case delay of a full ring, on top of the DMA buffers
+uint32_t OutputPipeline::getAddedLatencyMicros(int sampleRate) const {
+    return (uint32_t) (((uint64_t) depth * blockSize * 1000000UL) / sampleRate);
+}
+
+void OutputPipeline::resetStats() {
+    stats = Stats();
+    stats.minFill = depth;
+}
+
@@ -0,0 +1,237 @@
+/*!
+ *  @file       ParallelRender.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <string.h>
+
+#include "ParallelRender.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <thread>
+#endif
+
+// -----------------------------------------------------------------------------
+#ifdef ARDUINO
+static const int RENDERTASKSTACKSIZE = 2048;
+static const int RENDERTASKPRIORITY = 2; // above the codec task
+static const int RENDERTASKCORE = 0;     // audio loop runs on core 1
+#endif
+
+static int clampWorkers(int nrOfWorkers) {
+    if (nrOfWorkers < 1)
+      return 1;
+    if (nrOfWorkers > ParallelRender::MAXWORKERS)
+      return ParallelRender::MAXWORKERS;
+    return nrOfWorkers;
+}
+
+// Arena size needed by begin(), a scratch buffer for every worker and a
+// partial buffer for every worker but the first
+size_t ParallelRender::arenaBytes(int newNrOfWorkers, int newBufferSize) {
+    int buffers = 2 * clampWorkers(newNrOfWorkers) - 1;
+    return buffers * (newBufferSize * sizeof(int32_t) + Arena::ALIGNMENT);
+}
+
+// Workers beyond the first are started here, with fewer the rest renders on
+// the caller. The buffers are taken from the arena and stay there after end().
+bool ParallelRender::begin(int newNrOfWorkers, int newBufferSize, RenderFunction function, void *toNewContext, Arena *toArena) {
+    newNrOfWorkers = clampWorkers(newNrOfWorkers);
+    renderFunction = function;
+    toContext = toNewContext;
+    maxBufferSize = newBufferSize;
+    running.store(true);
+
+    nrOfWorkers = 0;
+    for(int index = 0; index < newNrOfWorkers; index++) {
+      Worker *toWorker = &workers[index];
+      toWorker->toOwner = this;
+      toWorker->index = index;
+      size_t mark = toArena->getUsed();
+      toWorker->toScratch = (int32_t *) toArena->allocate(newBufferSize * sizeof(int32_t));
+      toWorker->toPartial = (index == 0) ? NULL : (int32_t *) toArena->allocate(newBufferSize * sizeof(int32_t));
+      if ((toWorker->toScratch == NULL) || ((index > 0) && (toWorker->toPartial == NULL)) ||
+          ((index > 0) && !startWorker(toWorker))) {
+        toArena->release(mark);
+        toWorker->toScratch = NULL;
+        toWorker->toPartial = NULL;
+        break;
+      }
+      nrOfWorkers++;
+    }
+
+    // Workers beyond the cores only take turns on a core and add waiting
+#ifdef ARDUINO
+    int cores = portNUM_PROCESSORS;
+#else
+    int cores = (int) std::thread::hardware_concurrency();
+#endif
+    maxActiveWorkers = nrOfWorkers;
+    if ((cores > 0) && (cores < maxActiveWorkers))
+      maxActiveWorkers = cores;
+    return nrOfWorkers == newNrOfWorkers;
+}
+
+// Lets more workers than cores render a block, or fewer, for tests of the
+// split over the workers on a host with few cores
+void ParallelRender::setMaxActiveWorkers(int count) {
+    if (count < 1)
+      count = 1;
+    if (count > nrOfWorkers)
+      count = nrOfWorkers;
+    maxActiveWorkers = count;
+}
+
+void ParallelRender::setMinItemsPerWorker(int count) {
+    minItemsPerWorker = (count < 1) ? 1 : count;
+}
+
+#ifdef ARDUINO
+
+bool ParallelRender::startWorker(Worker *toWorker) {
+    TaskHandle_t handle = NULL;
+    if (xTaskCreatePinnedToCore(
+          workerLoop, "render", RENDERTASKSTACKSIZE, toWorker,
+          RENDERTASKPRIORITY, &handle, RENDERTASKCORE) != pdPASS)
+      return false;
+    toWorker->toTask = handle;
+    return true;
+}
+
+// Sleeps until render() notifies it, a spinning task would starve the idle task of its core
+void ParallelRender::workerLoop(void *toArgument) {
+    Worker *toWorker = (Worker *) toArgument;
+    ParallelRender *toOwner = toWorker->toOwner;
+    while(1) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      toOwner->renderPart(toWorker->index, toWorker->toPartial);
+      toOwner->done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+#else
+
+bool ParallelRender::startWorker(Worker *toWorker) {
+    toWorker->toTask = new std::thread(workerLoop, (void *) toWorker);
+    return true;
+}
+
+void ParallelRender::workerLoop(void *toArgument) {
+    Worker *toWorker = (Worker *) toArgument;
+    ParallelRender *toOwner = toWorker->toOwner;
+    uint32_t seen = 0;
+    while(1) {
+      uint32_t current;
+      while ((current = toOwner->generation.load(std::memory_order_acquire)) == seen) {
+        if (!toOwner->running.load(std::memory_order_acquire))
+          return;
+        std::this_thread::yield();
+      }
+      seen = current;
+      if (toWorker->index >= (int) (current & 15))
+        continue; // not needed for this block
+      toOwner->renderPart(toWorker->index, toWorker->toPartial);
+      toOwner->done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+#endif
+
+// Stops the workers, must not be called during render()
+void ParallelRender::end() {
+    running.store(false, std::memory_order_release);
+    for(int index = 0; index < nrOfWorkers; index++) {
+      Worker *toWorker = &workers[index];
+      if (toWorker->toTask != NULL) {
+#ifdef ARDUINO
+        vTaskDelete((TaskHandle_t) toWorker->toTask);
+#else
+        std::thread *toThread = (std::thread *) toWorker->toTask;
+        toThread->join();
+        delete toThread;
+#endif
+        toWorker->toTask = NULL;
+      }
+      toWorker->toScratch = NULL;
+      toWorker->toPartial = NULL;
+    }
+    nrOfWorkers = 0;
+}
+
+// Every activeWorkers-th item, starting at the worker index
+void ParallelRender::renderPart(int worker, int32_t mix[]) {
+    if (worker > 0)
+      memset(mix, 0, bufferSize * sizeof(int32_t));
+    int32_t *toScratch = workers[worker].toScratch;
+    for(int index = worker; index < nrOfItems; index += activeWorkers) {
+      renderFunction(toContext, toItems[index], mix, toScratch, bufferSize);
+    }
+}
+
+// Adds all items to mix, returns when every worker is done
+void ParallelRender::render(const int items[], int newNrOfItems, int32_t mix[], int newBufferSize) {
+    toItems = items;
+    nrOfItems = newNrOfItems;
+    bufferSize = (newBufferSize > maxBufferSize) ? maxBufferSize : newBufferSize;
+
+    // A worker only pays off with a few voices of its own
+    int active = newNrOfItems / minItemsPerWorker;
+    if (active > maxActiveWorkers)
+      active = maxActiveWorkers;
+    if (active < 1)
+      active = 1;
+    int helpers = active - 1;
+    activeWorkers = active;
+    if (helpers == 0) {
+      for(int index = 0; index < nrOfItems; index++) {
+        renderFunction(toContext, toItems[index], mix, workers[0].toScratch, bufferSize);
+      }
+      return;
+    }
+
+    done.store(0, std::memory_order_relaxed);
+    uint32_t blocks = (generation.load(std::memory_order_relaxed) >> 4) + 1;
+    generation.store((blocks << 4) | (uint32_t) active, std::memory_order_release);
+#ifdef ARDUINO
+    for(int index = 1; index < active; index++) {
+      xTaskNotifyGive((TaskHandle_t) workers[index].toTask);
+    }
+#endif
+    renderPart(0, mix);
+    while (done.load(std::memory_order_acquire) < helpers) {
+#ifndef ARDUINO
+      std::this_thread::yield(); // the host may have fewer cores than workers
+#endif
+    }
+
+    // Fixed order, worker 1 first
+    for(int worker = 1; worker < active; worker++) {
+      const int32_t *toPartial = workers[worker].toPartial;
+      for(int index = 0; index < bufferSize; index++) {
+        mix[index] += toPartial[index];
+      }
+    }
+}
@@ -24,6 +24,7 @@
  * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
  * THE SOFTWARE.
  */
+#include <new>
 #include <Arduino.h>
 #include "driver/i2s.h"
 
@@ -31,6 +32,35 @@
 #include "WaveGenerator.h"
 
 // -----------------------------------------------------------------------------
+static const uint32_t MAXCLOCKINTERVAL = 100000; // micros, longer means the clock stopped
+static const int VOICELIMITBLOCKS = 64; // blocks between raising the voice limit by one
+static const int MINVOICELIMIT = 4;     // the CPU budget never takes the voices below this
+static const int OUTPUTTASKSTACKSIZE = 2048;
+static const int OUTPUTTASKPRIORITY = 3; // above the render worker, the DMA must not wait
+static const int OUTPUTTASKCORE = 0;     // audio loop runs on core 1
+static const TickType_t OUTPUTWAITTICKS = pdMS_TO_TICKS(2); // about a block, then send silence
+static const int ADAPTIVEMINBLOCKSIZE = 64;  // adaptive block size range
+static const int ADAPTIVEFEWVOICES = 4;      // blocks shrink while at most this many voices play
+static const int ADAPTIVEGROWPERCENT = 70;   // render load that doubles the block size
+static const int ADAPTIVESHRINKPERCENT = 35; // render load under which it may halve again
+static const int ADAPTIVEBLOCKS = 256;       // quiet blocks before the block size halves
+static const int ADAPTIVEHOLDBLOCKS = 32;    // blocks without a change after a change
+
+// Block size and DMA buffers of the output profiles, see setOutputProfile()
+struct OutputProfile {
+  const char *name;
+  int blockSize; // ADAPTIVEBLOCKSIZE follows the voices and the load
+  int dmaBuffers;
+  int dmaLength;
+};
+static const OutputProfile OUTPUTPROFILES[PolySynth::NROFOUTPUTPROFILES] = {
+  { "low latency", 64, 2, 64 },
+  { "balanced", 128, 2, 128 },
+  { "safe", BUFFERSIZE, NROFBUFFERS, BUFFERSIZE },
+  { "adaptive", PolySynth::ADAPTIVEBLOCKSIZE, 4, ADAPTIVEMINBLOCKSIZE },
+  { "custom", BUFFERSIZE, NROFBUFFERS, BUFFERSIZE }
+};
+
 bool PolySynth::setPinout(int bclk, int wclk, int dout)
 {
   i2s_pin_config_t pins = {
@@ -71,25 +101,67 @@ void PolySynth::installDriver(int i2sBufferSize, int i2sNrOfBuffers) {
     setPinout(IIS_SCLK /*bclkPin*/, IIS_LCLK /*wclkPin*/, IIS_DSIN /*doutPin*/);
 }
 
-void PolySynth::initFreeWaveGenerators() {
-    toFreeWaveGenerators = &wavegenerators[0];
+// Arena size needed for the voice pool and the render buffers
+size_t PolySynth::voiceArenaBytes(int voices, int renderWorkers) {
+    return voices * sizeof(WaveGenerator) + alignof(WaveGenerator) +
+      ParallelRender::arenaBytes(renderWorkers, BUFFERSIZE);
+}
 
-    WaveGenerator *toWaveGenerator;
+void PolySynth::begin(int voices, int renderWorkers, int pipelineDepth) {
+    if (voices < 1)
+      voices = 1;
+    if (voices > MAXWAVEGENERATORS)
+      voices = MAXWAVEGENERATORS;
+    nrOfVoices = voices;
 
-    // link wave generators together in free linked list
-    for(int index = 0; index < (NROFWAVEGENERATORS-1); index++) {
-      toWaveGenerator = &wavegenerators[index];
-      toWaveGenerator->toNextFreeWaveGenerator = 
-        &wavegenerators[index+1];
+    // MIDI defaults for the patch and controllers of each channel
+    for(int channelIndex = 0; channelIndex < NROFMIDICHANNELS; channelIndex++) {
+      channels[channelIndex].begin(TRIANGLESTYLE);
     }
-    // Last wavegenerator has no next
-    toWaveGenerator = &wavegenerators[NROFWAVEGENERATORS-1];
-    toWaveGenerator->toNextFreeWaveGenerator = NULL;
-}
 
-void PolySynth::begin() {
+    velocityCurves.begin();
+    filterTables.begin(SAMPLERATE);
+
+    // Wave tables, voices and delay lines are taken from one arena, sized
+    // here and split in chunks that fit the free blocks of the heap. Without
+    // room for the delay lines the effects stay off, without room for the
+    // rest no notes play.
+    size_t neededBytes = voiceArenaBytes(nrOfVoices, renderWorkers) + WaveFactory::arenaBytes();
+    bool withEffects = arena.begin(neededBytes + Effects::arenaBytes(SAMPLERATE));
+    if (!withEffects && !arena.begin(neededBytes)) {
+      Serial.printf("ERROR: No memory for the wave tables and voices, %u bytes, largest free block %u\n\r",
+        (unsigned) neededBytes, (unsigned) Arena::getLargestFreeBlock());
+    }
+
+    size_t mark = arena.getUsed();
+    wavegenerators = (WaveGenerator *) arena.allocate(nrOfVoices * sizeof(WaveGenerator), alignof(WaveGenerator));
+    if (wavegenerators == NULL) {
+      nrOfVoices = 0;
+    }
+    for(int index = 0; index < nrOfVoices; index++) {
+      new (&wavegenerators[index]) WaveGenerator();
+    }
+    if (!voiceRender.begin(renderWorkers, BUFFERSIZE, renderVoice, this, &arena)) {
+      Serial.printf("ERROR: Started %d of %d render workers\n\r",
+        voiceRender.getNrOfWorkers(), renderWorkers);
+    }
+    voiceBytes = arena.getUsed() - mark;
+
+    mark = arena.getUsed();
+    if (!withEffects || !effects.begin(&arena, SAMPLERATE)) {
+      Serial.printf("ERROR: No memory for the effects, %u bytes, largest free block %u\n\r",
+        (unsigned) Effects::arenaBytes(SAMPLERATE), (unsigned) Arena::getLargestFreeBlock());
+    }
+    effectBytes = arena.getUsed() - mark;
+    profiler.begin(((uint32_t) BUFFERSIZE * 1000000UL) / SAMPLERATE);
+    limiter.begin(SAMPLERATE);
+
     // Initialise free list of wave generators
-    initFreeWaveGenerators();
+    voiceAllocator.begin(wavegenerators, nrOfVoices, channels);
+    voiceLimit = nrOfVoices;
+    governor.reset();
+    stealFadeStep = envelopeStep(STEALFADEMS);
+    masterGain.set(UNITYGAIN);
 
     // IO22 is debug pin output to channel B of Picoscope
     pinMode(GPIO_NUM_22, OUTPUT);
@@ -102,95 +174,777 @@ void PolySynth::begin() {
         Serial.printf("ERROR: AC101 failed\n\r");
         delay(1000);
     }
+    const AC101::Stats_t &initStats = ac.GetInitStats();
+    Serial.printf("AC101 init: %lu us (%lu ms waiting), %lu transactions, %lu reads, %lu writes\n\r",
+      (unsigned long) initStats.micros, (unsigned long) initStats.delayMs,
+      (unsigned long) initStats.transactions, (unsigned long) initStats.reads,
+      (unsigned long) initStats.writes);
    
     ac.SetVolumeHeadphone(volume);
     ac.SetVolumeSpeaker(0);  
+
+    // From here on the audio chip is only controlled through the command queue
+    codecControl.begin(&ac);
     
-    installDriver(BUFFERSIZE, NROFBUFFERS);
+    installDriver(dmaLength, dmaBuffers);
 
     // Start I2S signal
     i2s_start((i2s_port_t) 0);
 
-    waveFactory.begin(); // Generates waves for the MIDI notes
+    // Generates waves for the MIDI notes
+    if (!waveFactory.begin(&arena)) {
+      Serial.printf("ERROR: No memory for the wave tables, %u bytes, largest free block %u\n\r",
+        (unsigned) WaveFactory::arenaBytes(), (unsigned) Arena::getLargestFreeBlock());
+    }
+    printMemory();
+
+    // Output task feeds the DMA while the loop renders ahead
+    if (pipelineDepth > 0) {
+      TaskHandle_t handle = NULL;
+      toRenderTask = xTaskGetCurrentTaskHandle();
+      if (!outputPipeline.begin(pipelineDepth, BUFFERSIZE) ||
+          (xTaskCreatePinnedToCore(
+            outputTask, "output", OUTPUTTASKSTACKSIZE, this,
+            OUTPUTTASKPRIORITY, &handle, OUTPUTTASKCORE) != pdPASS)) {
+        // Without the task the loop writes to the DMA itself
+        Serial.printf("ERROR: Unable to start output task\n\r");
+        handle = NULL;
+      }
+      toOutputTask = handle;
+    }
 }
 
 void PolySynth::loop() {
+    uint32_t *toBlock = buffer;
+    if (toOutputTask != NULL) {
+      toBlock = outputPipeline.getWriteBlock();
+      if (toBlock == NULL) {
+        // Render is a full pipeline ahead, sleep until the output takes a block
+        ulTaskNotifyTake(pdTRUE, OUTPUTWAITTICKS);
+        return;
+      }
+    } else {
+      reconfigureDma();
+    }
+    if (blockSize != nextBlockSize)
+      changeBlockSize(nextBlockSize);
 
     // measure time used for wave generation
     digitalWrite(GPIO_NUM_22, HIGH);
+    profiler.startBlock();
     
-    // Use first generator to fill buffer initially
-    WaveGenerator *wg = &wavegenerators[0];
-    wg->setSamplesInBuffer(buffer, BUFFERSIZE);
-    if (wg->clearStopping()) {
-        wg->toNextFreeWaveGenerator = toFreeWaveGenerators;
-        toFreeWaveGenerators = wg;
-    }
+    // Pitch bend, tuning and vibrato, once per block for each channel
+    updatePitch();
+
+    // Fade out voices above a lowered voice limit
+    enforceVoiceLimit();
 
-    // Add samples to buffer for each following generator
-    for(int index = 1; index < NROFWAVEGENERATORS; index++) {
+    // Block rate updates of each playing generator, envelope and channel
+    // gain are updated once per block, the gain ramps across it
+    int nrOfActive = 0;
+    for(int index = 0; index < nrOfVoices; index++) {
         WaveGenerator *wg = &wavegenerators[index];
-        wg->addSamplesToBuffer(buffer, BUFFERSIZE);
+        if (!wg->isActive())
+          continue;
+        activeVoices[nrOfActive++] = index;
+        int32_t envelopeLevel = wg->advanceEnvelope(blockSize);
+        wg->setTargetGain(voiceGain(wg, envelopeLevel));
+        wg->setTargetIncrement(voiceIncrement(wg));
+        updateFilter(wg, envelopeLevel);
+    }
+    renderedVoices = nrOfActive;
+
+    // Add samples of the playing generators to the mix bus, spread over the workers
+    memset(mix, 0, sizeof(mix));
+    voiceRender.render(activeVoices, nrOfActive, mix, blockSize);
+
+    for(int active = 0; active < nrOfActive; active++) {
+        WaveGenerator *wg = &wavegenerators[activeVoices[active]];
         if (wg->clearStopping()) {
-            wg->toNextFreeWaveGenerator = toFreeWaveGenerators;
-            toFreeWaveGenerators = wg;
+            if (wg->hasPendingNote()) {
+              // Fade out of a stolen voice is done, start the waiting note
+              voiceAllocator.takeOver(wg);
+              startVoice(wg, wg->pendingChannel, wg->pendingPitch, wg->pendingVelocity);
+              wg->clearPendingNote();
+            } else {
+              voiceAllocator.freeVoice(wg);
+            }
+        }
+    }
+
+    profiler.endSection(Profiler::VOICESECTION);
+
+    // Apply master gain, the limiter makes the output samples of the block before
+    int32_t *toRight = mix;
+    masterGain.beginBlock(blockSize);
+    if (effects.isActive()) {
+        effects.process(mix, mixRight, blockSize);
+        profiler.endSection(Profiler::EFFECTSSECTION);
+        toRight = mixRight;
+        for(int index = 0; index < blockSize; index++) {
+            int32_t gain = masterGain.next();
+            mix[index] = ((int64_t) mix[index] * gain) >> 15;
+            mixRight[index] = ((int64_t) mixRight[index] * gain) >> 15;
+        }
+    } else {
+        for(int index = 0; index < blockSize; index++) {
+            mix[index] = ((int64_t) mix[index] * masterGain.next()) >> 15;
         }
     }
+    masterGain.endBlock();
+    int outputSize = limiter.process(mix, toRight, toBlock, blockSize);
+    sampleClock += blockSize;
+    profiler.endSection(Profiler::OUTPUTSECTION);
+    profiler.endBlock();
+    if (governor.update(profiler.getLastBlockMicros(), profiler.getBlockMicros()))
+      applyGovernor();
+    updateVoiceLimit();
+    updateBlockSize();
 
     digitalWrite(GPIO_NUM_22, LOW);
 
-    // write buffer to AC101
+    traceOutput(nrOfActive, outputSize);
+
+    if (toOutputTask != NULL) {
+      outputPipeline.commitWrite(outputSize);
+      xTaskNotifyGive((TaskHandle_t) toOutputTask);
+    } else {
+      writeBlock(buffer, outputSize);
+    }
+
+    // Without the codec task the queued codec commands are sent from here,
+    // after the block, while the DMA plays it
+    if (!codecControl.hasWorker())
+      codecControl.service();
+}
+
+// Voices that made their first sound in this block. The sample leaves the
+// DMA after the audio queued in the driver and the pipeline, the block the
+// limiter hands out now and the samples before it in this block.
+void PolySynth::traceOutput(int nrOfActive, int outputSize) {
+    int queued = -1;
+    uint32_t now = 0;
+    for(int active = 0; active < nrOfActive; active++) {
+      WaveGenerator *wg = &wavegenerators[activeVoices[active]];
+      if ((wg->trace.voiceMicros == 0) || (wg->firstSample < 0))
+        continue;
+      if (queued < 0) {
+        queued = outputSize + dmaBuffers * dmaLength;
+        if (toOutputTask != NULL)
+          queued += outputPipeline.getQueuedSamples();
+        now = micros();
+      }
+      int ahead = queued + wg->firstSample;
+      wg->trace.outputMicros = now + (uint32_t) (((uint64_t) ahead * 1000000UL) / SAMPLERATE);
+      latencyTrace.record(wg->trace);
+
+      uint32_t latency = wg->trace.outputMicros - wg->trace.voiceMicros;
+      LatencyStats *toStats = &latencyStats[outputProfile];
+      toStats->notes++;
+      toStats->totalMicros += latency;
+      if (latency > toStats->maxMicros)
+        toStats->maxMicros = latency;
+      wg->trace.voiceMicros = 0;
+    }
+}
+
+// write buffer to AC101, waits until the DMA has room
+void PolySynth::writeBlock(const uint32_t *toBlock, int size) {
     size_t bytesWritten;
-    i2s_write((i2s_port_t)PORTNR, buffer, BUFFERSIZE*4, &bytesWritten, portMAX_DELAY);
-    if (bytesWritten != (BUFFERSIZE*4)) {
+    i2s_write((i2s_port_t)PORTNR, toBlock, size*4, &bytesWritten, portMAX_DELAY);
+    if (bytesWritten != (size_t) (size*4)) {
         Serial.printf("ERROR: I2S write could not send bytes\n\r");
     }
 }
 
+// New DMA buffers asked for by setDmaBuffers(), done by the task that
+// writes to the I2S driver, between two writes. The audio stops for a moment.
+void PolySynth::reconfigureDma() {
+    uint32_t request = pendingDma.exchange(0);
+    if (request == 0)
+      return;
+    i2s_driver_uninstall((i2s_port_t)PORTNR);
+    dmaBuffers = request >> 16;
+    dmaLength = request & 0xffff;
+    installDriver(dmaLength, dmaBuffers);
+    i2s_start((i2s_port_t)PORTNR);
+}
+
+// Feeds the DMA from the pipeline, so the loop renders the next block while
+// this task waits in i2s_write. When the render is late it sends silence
+// rather than letting the DMA repeat an old block.
+void PolySynth::outputTask(void *toPolySynth) {
+    PolySynth *toSynth = (PolySynth *) toPolySynth;
+    OutputPipeline *toPipeline = &toSynth->outputPipeline;
+    while(1) {
+      toSynth->reconfigureDma();
+      int size;
+      const uint32_t *toBlock = toPipeline->getReadBlock(&size);
+      if (toBlock == NULL) {
+        ulTaskNotifyTake(pdTRUE, OUTPUTWAITTICKS);
+        toBlock = toPipeline->getReadBlock(&size);
+      }
+      if (toBlock == NULL) {
+        toPipeline->countUnderrun();
+        int silenceSize = (toSynth->dmaLength < BUFFERSIZE) ? toSynth->dmaLength : BUFFERSIZE;
+        toSynth->writeBlock(toSynth->silence, silenceSize);
+        continue;
+      }
+      toSynth->writeBlock(toBlock, size);
+      toPipeline->commitRead();
+      xTaskNotifyGive((TaskHandle_t) toSynth->toRenderTask);
+    }
+}
+
+// Samples of one voice, called by the render workers. A voice only
+// touches its own generator and the scratch buffer of the worker.
+void PolySynth::renderVoice(void *toSynth, int voice, int32_t mix[], int32_t scratch[], int bufferSize) {
+    WaveGenerator *wg = &((PolySynth *) toSynth)->wavegenerators[voice];
+    // A traced note waits for its first sound, not for the fade of a stolen voice
+    bool traced = (wg->trace.voiceMicros != 0) && !wg->hasPendingNote();
+    if (!wg->filter.isEnabled() && !traced) {
+      wg->addSamplesToMix(mix, bufferSize);
+      return;
+    }
+
+    memset(scratch, 0, bufferSize * sizeof(int32_t));
+    wg->addSamplesToMix(scratch, bufferSize);
+    if (traced) {
+      wg->firstSample = -1;
+      for(int index = 0; index < bufferSize; index++) {
+        if (scratch[index] != 0) {
+          wg->firstSample = index;
+          break;
+        }
+      }
+    }
+    if (wg->filter.isEnabled()) {
+      wg->filter.process(scratch, mix, bufferSize);
+    } else {
+      for(int index = 0; index < bufferSize; index++) {
+        mix[index] += scratch[index];
+      }
+    }
+}
+
 // Debug function to just run some wavesources with a specific pitch
 void PolySynth::testGenerate(byte pitch1, byte pitch2) {
+    if ((nrOfVoices < 2) || (waveFactory.getNote(pitch1) == NULL) || (waveFactory.getNote(pitch2) == NULL))
+      return;
     WaveGenerator *wg1 = &wavegenerators[0];
     Note *toNote = waveFactory.getNote(pitch1);
-    wg1->setWave(toNote->samples[0], toNote->sampleSizes[0], toNote->delta, 0);
+    wg1->setWave(toNote->samples[0], toNote->sampleSizes[0], toNote->phaseIncrement);
 
     WaveGenerator *wg2 = &wavegenerators[1];
     toNote = waveFactory.getNote(pitch2);
-    wg2->setWave(toNote->samples[0], toNote->sampleSizes[0], toNote->delta, 0);
+    wg2->setWave(toNote->samples[0], toNote->sampleSizes[0], toNote->phaseIncrement);
 }
 
+// Does not wait for the audio chip, the volume is sent by the codec task
 void PolySynth::setVolume(byte volume) {
-    ac.SetVolumeHeadphone(volume);
-    ac.SetVolumeSpeaker(volume);
+    codecControl.post(CodecControl::SETVOLUMEHEADPHONE, volume);
+    codecControl.post(CodecControl::SETVOLUMESPEAKER, volume);
 }
 
-void PolySynth::startNote(byte pitch, byte velocity) {
-  if (toFreeWaveGenerators != NULL) {
-    // Find free wavegenerator
-    WaveGenerator *toWaveGenerator = toFreeWaveGenerators;
-  
-    // Remove wavegenerator from list of free wavegenerators
-    toFreeWaveGenerators = toWaveGenerator->toNextFreeWaveGenerator;
+void PolySynth::startVoice(WaveGenerator *toWaveGenerator, int channelIndex, byte pitch, byte velocity) {
+    MidiChannel *toChannel = &channels[channelIndex];
 
-    // Set pitch
+    // Set pitch, with the wave style of the channel. The pitch factor is only
+    // kept up to date while the channel plays, so bring it up to date first.
+    byte style = toChannel->style;
+    toChannel->updatePitchFactor(vibratoLfo);
     Note *toNote = waveFactory.getNote(pitch);
-    toWaveGenerator->setWave(toNote->samples[style], toNote->sampleSizes[style], toNote->delta, toNote->sampleErrors[style]);
-    // Remember in the note that is playing, which wavegenerator is used
-    toNote->toWaveGenerator = toWaveGenerator;
+    toWaveGenerator->channel = channelIndex;
+    toWaveGenerator->pitch = pitch;
+    toWaveGenerator->noteIncrement = toNote->phaseIncrement;
+    toWaveGenerator->setWave(toNote->samples[style], toNote->sampleSizes[style], voiceIncrement(toWaveGenerator));
+    toWaveGenerator->velocityGain = velocityCurves.getGain(toChannel->velocityCurve, velocity);
+    toWaveGenerator->filter.reset();
+    toWaveGenerator->setGain(voiceGain(toWaveGenerator, toWaveGenerator->startEnvelope(toChannel->attackStep)));
+}
 
-    Serial.printf("+ n:%s p:%d f:%f\n\r", toNote->name, pitch, toNote->frequency);
-  }
+// Gain of a voice from its channel, velocity and envelope level
+int32_t PolySynth::voiceGain(WaveGenerator *toWaveGenerator, int32_t envelopeLevel) {
+    int32_t noteGain = (channels[toWaveGenerator->channel].gain * toWaveGenerator->velocityGain) >> 15;
+    return (noteGain * envelopeLevel) >> 15;
 }
 
-void PolySynth::stopNote(byte pitch, byte velocity) {
+void PolySynth::startNote(byte channel, byte pitch, byte velocity) {
+  int channelIndex = (channel - 1) & 0x0f;
   Note *toNote = waveFactory.getNote(pitch);
-  WaveGenerator *toWaveGenerator = (WaveGenerator *) toNote->toWaveGenerator;
+  if (toNote == NULL)
+    return;
+
+  uint32_t now = micros() | 1; // 0 means not seen
+  MidiChannel *toChannel = &channels[channelIndex];
+  toChannel->keysDown.set(pitch);
+  toChannel->sustained.clear(pitch);
+
+  // Same note again before its note off, release the voice that plays it
+  WaveGenerator *toPlaying = voiceAllocator.findVoice(channelIndex, pitch);
+  if (toPlaying != NULL)
+    releaseVoice(toPlaying, channelIndex, pitch);
+
+  WaveGenerator *toStolen;
+  WaveGenerator *toWaveGenerator = voiceAllocator.allocate(channelIndex, &toStolen);
+  if (toWaveGenerator != NULL) {
+    startVoice(toWaveGenerator, channelIndex, pitch, velocity);
+  } else
+  if (toStolen != NULL) {
+    // The note of the stolen voice no longer owns it
+    voiceAllocator.unassign(toStolen->channel, toStolen->pitch, toStolen);
+    // Fade out without click, the new note starts when it is silent
+    toStolen->steal(stealFadeStep, channelIndex, pitch, velocity);
+    toWaveGenerator = toStolen;
+  } else {
+    Serial.printf("! c:%d n:%s p:%d dropped\n\r", channel, toNote->name, pitch);
+    return;
+  }
+  // Remember which wavegenerator plays the note of this channel
+  voiceAllocator.assign(channelIndex, pitch, toWaveGenerator);
+
+  // Times of the MIDI message, the output time follows with the first sound
+  toWaveGenerator->trace.byteMicros = midiByteMicros;
+  toWaveGenerator->trace.parseMicros = midiParseMicros;
+  toWaveGenerator->trace.voiceMicros = now;
+  toWaveGenerator->trace.outputMicros = 0;
+  toWaveGenerator->firstSample = -1;
+  midiByteMicros = 0;
+  midiParseMicros = 0;
+
+  Serial.printf("+ c:%d n:%s p:%d f:%f\n\r", channel, toNote->name, pitch, toNote->frequency);
+}
+
+void PolySynth::stopNote(byte channel, byte pitch, byte velocity) {
+  int channelIndex = (channel - 1) & 0x0f;
+  MidiChannel *toChannel = &channels[channelIndex];
+  pitch &= 0x7f;
+  toChannel->keysDown.clear(pitch);
+  if (toChannel->sustainPedal || toChannel->isHeldBySostenuto(pitch)) {
+    // Keep playing until the pedal goes up
+    toChannel->sustained.set(pitch);
+    return;
+  }
+
+  WaveGenerator *toWaveGenerator = voiceAllocator.findVoice(channelIndex, pitch);
   if (toWaveGenerator != NULL)
-    toWaveGenerator->clearWave();
-  toNote->toWaveGenerator = NULL;  
+    releaseVoice(toWaveGenerator, channelIndex, pitch);
+
+  Serial.printf("- c:%d p:%d\n\r", channel, pitch);
+}
+
+// Ends the note of a channel that the voice plays or waits for
+void PolySynth::releaseVoice(WaveGenerator *toWaveGenerator, int channelIndex, byte pitch) {
+  if (toWaveGenerator->hasPendingNote()) {
+    // Note stopped before its stolen voice was free, let the voice just fade out
+    voiceAllocator.cancelSteal(toWaveGenerator);
+    toWaveGenerator->clearPendingNote();
+  } else {
+    toWaveGenerator->release(channels[channelIndex].releaseStep);
+  }
+  voiceAllocator.unassign(channelIndex, pitch, toWaveGenerator);
+}
+
+// Channel volume, expression and envelope times apply from the next block,
+// no audio chip traffic is involved
+void PolySynth::controlChange(byte channel, byte number, byte value) {
+  int channelIndex = (channel - 1) & 0x0f;
+  if (number == MidiChannel::CCSUSTAIN) {
+    setSustainPedal(channelIndex, value >= 64);
+  } else
+  if (number == MidiChannel::CCSOSTENUTO) {
+    setSostenutoPedal(channelIndex, value >= 64);
+  } else {
+    channels[channelIndex].controlChange(number, value);
+  }
+}
+
+// Sustain up releases the notes it held, except those sostenuto still holds
+void PolySynth::setSustainPedal(int channelIndex, bool down) {
+  MidiChannel *toChannel = &channels[channelIndex];
+  if (down == toChannel->sustainPedal)
+    return;
+  toChannel->sustainPedal = down;
+  if (down)
+    return;
+
+  NoteSet release = toChannel->sustained;
+  if (toChannel->sostenutoPedal) {
+    for(int word = 0; word < 4; word++) {
+      release.words[word] &= ~toChannel->sostenutoKeys.words[word];
+    }
+  }
+  releaseHeldNotes(channelIndex, release);
+}
+
+// Sostenuto down holds the keys that are down at that moment
+void PolySynth::setSostenutoPedal(int channelIndex, bool down) {
+  MidiChannel *toChannel = &channels[channelIndex];
+  if (down == toChannel->sostenutoPedal)
+    return;
+  toChannel->sostenutoPedal = down;
+  if (down) {
+    toChannel->sostenutoKeys = toChannel->keysDown;
+    return;
+  }
+
+  NoteSet release = toChannel->sustained;
+  for(int word = 0; word < 4; word++) {
+    release.words[word] &= toChannel->sostenutoKeys.words[word];
+  }
+  toChannel->sostenutoKeys.clearAll();
+  if (!toChannel->sustainPedal)
+    releaseHeldNotes(channelIndex, release);
+}
+
+// Releases the voices of the held notes, walks the set bits only
+void PolySynth::releaseHeldNotes(int channelIndex, const NoteSet &notes) {
+  MidiChannel *toChannel = &channels[channelIndex];
+  for(int word = 0; word < 4; word++) {
+    uint32_t bits = notes.words[word];
+    toChannel->sustained.words[word] &= ~bits;
+    while (bits != 0) {
+      byte pitch = (word << 5) + __builtin_ctz(bits);
+      bits &= bits - 1; // clear lowest set bit
+      WaveGenerator *toWaveGenerator = voiceAllocator.findVoice(channelIndex, pitch);
+      if (toWaveGenerator != NULL)
+        releaseVoice(toWaveGenerator, channelIndex, pitch);
+    }
+  }
+}
+
+// Selects the wave style of one channel, returns false for unknown programs
+bool PolySynth::programChange(byte channel, byte number) {
+  return channels[(channel - 1) & 0x0f].programChange(number);
+}
+
+// Phase increment of a voice with the bend, tuning and vibrato of its channel
+int32_t PolySynth::voiceIncrement(WaveGenerator *toWaveGenerator) {
+    return channels[toWaveGenerator->channel].pitchIncrement(toWaveGenerator->noteIncrement);
+}
+
+// Filter coefficients for the next block, from the channel cutoff with key
+// tracking and the envelope level of the voice
+void PolySynth::updateFilter(WaveGenerator *toWaveGenerator, int32_t envelopeLevel) {
+    MidiChannel *toChannel = &channels[toWaveGenerator->channel];
+    bool filterOn = toChannel->isFilterOn() && (governor.getLevel() < Governor::NOFILTERS);
+    toWaveGenerator->filter.setEnabled(filterOn);
+    if (!filterOn)
+      return;
+
+    // Cutoff as MIDI note in 1/256 semitones
+    int32_t cutoff = toChannel->filterCutoff << 8;
+    cutoff += ((toWaveGenerator->pitch - 60) * toChannel->filterKeyTrack * 256) / 127;
+    cutoff += ((toChannel->filterEnvelope - 64) * envelopeLevel) >> 7;
+    toWaveGenerator->filter.setCoefficients(filterTables.getFrequency(cutoff),
+      filterTables.getDamping(toChannel->filterResonance));
+}
+
+// Advances the vibrato LFO by one block and updates the pitch of the playing channels
+void PolySynth::updatePitch() {
+    vibratoPhase += (2.0f * (float) PI * VIBRATORATEHZ * blockSize) / SAMPLERATE;
+    if (vibratoPhase > (float) PI)
+      vibratoPhase -= 2.0f * (float) PI;
+    vibratoLfo = sinf(vibratoPhase);
+
+    for(int channelIndex = 0; channelIndex < NROFMIDICHANNELS; channelIndex++) {
+      MidiChannel *toChannel = &channels[channelIndex];
+      if (toChannel->activeVoices > 0)
+        toChannel->updatePitchFactor(vibratoLfo);
+    }
+}
+
+// Bend -8192..8191, the range is set per channel with RPN 0
+void PolySynth::pitchBend(byte channel, int bend) {
+  channels[(channel - 1) & 0x0f].pitchBendChange(bend);
+}
+
+// Handles the synthesizer SysEx messages, returns false for other messages
+bool PolySynth::systemExclusive(const byte *data, unsigned size) {
+  if ((size < 4) || (data[0] != 0xF0) || (data[1] != SYSEXID) || (data[size-1] != 0xF7))
+    return false;
+
+  byte command = data[2];
+  if ((command == SYSEXCUSTOMVELOCITYCURVE) && (size == (4 + NROFVELOCITIES))) {
+    velocityCurves.setCustomCurve(&data[3]);
+    return true;
+  }
+  if ((command == SYSEXSELECTVELOCITYCURVE) && (size == 6)) {
+    byte curve = data[4];
+    if (curve >= VelocityCurves::NROFCURVES)
+      return false;
+    for(int channelIndex = 0; channelIndex < NROFMIDICHANNELS; channelIndex++) {
+      if ((data[3] == 0x7F) || (data[3] == channelIndex))
+        channels[channelIndex].velocityCurve = curve;
+    }
+    return true;
+  }
+  if ((command == SYSEXOUTPUTPROFILE) && (size == 5)) {
+    if (data[3] >= CUSTOMPROFILE)
+      return false;
+    setOutputProfile(data[3]);
+    return true;
+  }
+  if ((command == SYSEXEFFECTPARAMETER) && (size == 6)) {
+    if (data[3] >= Effects::NROFPARAMETERS)
+      return false;
+    setEffect(data[3], data[4]);
+    return true;
+  }
+  return false;
+}
+
+// Effects parameter 0..127, see Effects for the parameter numbers
+void PolySynth::setEffect(uint8_t parameter, uint8_t value) {
+  effects.setParameter(parameter, value);
+}
+
+// MIDI clock, 24 per beat, sets the tempo of the delay once per beat
+void PolySynth::midiClock() {
+  uint32_t now = micros();
+  uint32_t interval = now - lastClockMicros;
+  lastClockMicros = now;
+  if (interval > MAXCLOCKINTERVAL) {
+    // First clock after a pause, start measuring again
+    clockMicros = 0;
+    clockCount = 0;
+    return;
+  }
+  clockMicros += interval;
+  clockCount++;
+  if (clockCount == 24) {
+    effects.setBeatMicros(clockMicros);
+    clockMicros = 0;
+    clockCount = 0;
+  }
+}
 
-  Serial.printf("- n:%s p:%d\n\r", toNote->name, pitch);
+// Digital master volume 0..127, ramped over one block
+void PolySynth::setMasterVolume(uint8_t volume) {
+  masterGain.setTarget(controllerToGain(volume));
 }
 
+// Sets the wave style of all channels
 void PolySynth::setStyle(byte newStyle) {
-  style = newStyle;
+  for(int channelIndex = 0; channelIndex < NROFMIDICHANNELS; channelIndex++) {
+    channels[channelIndex].style = newStyle;
+  }
+}
+
+void PolySynth::setStealPolicy(int policy) {
+  voiceAllocator.setStealPolicy(policy);
+}
+
+void PolySynth::setChannelPriority(byte channel, uint8_t priority) {
+  channels[(channel - 1) & 0x0f].priority = priority;
+}
+
+// Caps the voices in use, AUTOVOICELIMIT lets the cap follow the CPU budget
+void PolySynth::setVoiceLimit(int limit) {
+  autoVoiceLimit = (limit == AUTOVOICELIMIT);
+  if (!autoVoiceLimit) {
+    voiceLimit = limit;
+    applyVoiceLimit();
+  }
+}
+
+// The lower of the voice limit and the cap of the governor
+void PolySynth::applyVoiceLimit() {
+  int limit = voiceLimit;
+  if ((governorVoiceCap > 0) && (governorVoiceCap < limit))
+    limit = governorVoiceCap;
+  voiceAllocator.setVoiceLimit(limit);
+}
+
+// Quality level changed. Polyphony is capped at three quarters of what
+// played when the governor stepped down, filters and effects read the
+// level as they go.
+void PolySynth::applyGovernor() {
+  int level = governor.getLevel();
+  if (level < Governor::CAPPEDPOLYPHONY) {
+    governorVoiceCap = 0;
+  } else
+  if (governorVoiceCap == 0) {
+    governorVoiceCap = (renderedVoices * 3) / 4;
+    if (governorVoiceCap < MINVOICELIMIT)
+      governorVoiceCap = MINVOICELIMIT;
+  }
+  applyVoiceLimit();
+  effects.setCheapInterpolation(level >= Governor::CHEAPINTERPOLATION);
+  effects.setBypass(level >= Governor::NOEFFECTS);
+}
+
+void PolySynth::enforceVoiceLimit() {
+  WaveGenerator *toExcess;
+  while ((toExcess = voiceAllocator.findExcessVoice()) != NULL) {
+    toExcess->fadeOut(stealFadeStep);
+  }
+}
+
+// Voices that fit in CPUBUDGETPERCENT of the block time, from the measured
+// render time per voice. The cost includes the fixed part of the voice
+// loop, so it errs on the safe side with few voices. The limit drops at
+// once and comes back one voice per VOICELIMITBLOCKS.
+void PolySynth::updateVoiceLimit() {
+  if (!autoVoiceLimit || (renderedVoices == 0))
+    return;
+  uint32_t voiceMicros = profiler.getSection(Profiler::VOICESECTION).last;
+  uint32_t cost = (voiceMicros << 8) / renderedVoices;
+  voiceCost = (voiceCost == 0) ? cost : voiceCost + (((int32_t) (cost - voiceCost)) >> 4);
+  if (voiceCost == 0)
+    return;
+
+  uint32_t otherMicros = profiler.getLastBlockMicros() - voiceMicros;
+  int32_t budget = (int32_t) ((profiler.getBlockMicros() * CPUBUDGETPERCENT) / 100) - (int32_t) otherMicros;
+  int affordable = (budget > 0) ? (int) (((uint32_t) budget << 8) / voiceCost) : 0;
+  if (affordable < MINVOICELIMIT)
+    affordable = MINVOICELIMIT;
+  if (affordable < voiceLimit) {
+    voiceLimit = affordable;
+    applyVoiceLimit();
+  } else
+  if ((affordable > voiceLimit) && (voiceLimit < nrOfVoices) && ((++voiceLimitBlocks) >= VOICELIMITBLOCKS)) {
+    voiceLimit++;
+    applyVoiceLimit();
+    voiceLimitBlocks = 0;
+  }
+}
+
+// Times of the MIDI message of the next note on, from the MIDI parser
+void PolySynth::setMidiTimes(uint32_t byteMicros, uint32_t parseMicros) {
+  midiByteMicros = byteMicros;
+  midiParseMicros = parseMicros;
+}
+
+// Samples per block from the next block on, a power of two from MINBUFFERSIZE
+// to BUFFERSIZE. ADAPTIVEBLOCKSIZE lets it follow the voices and the load.
+void PolySynth::setBlockSize(int size) {
+  outputProfile = CUSTOMPROFILE;
+  adaptiveBlockSize = (size == ADAPTIVEBLOCKSIZE);
+  if (adaptiveBlockSize) {
+    adaptiveBlocks = 0;
+    return;
+  }
+  int newSize = MINBUFFERSIZE;
+  while ((newSize < size) && (newSize < BUFFERSIZE))
+    newSize <<= 1;
+  nextBlockSize = newSize;
+}
+
+// Nr and length in samples of the I2S DMA buffers, their total is the
+// audio queued in the driver. Reinstalls the driver, which gives a short gap.
+void PolySynth::setDmaBuffers(int count, int length) {
+  outputProfile = CUSTOMPROFILE;
+  if (count < 2)
+    count = 2;
+  if (count > MAXDMABUFFERS)
+    count = MAXDMABUFFERS;
+  if (length < MINBUFFERSIZE)
+    length = MINBUFFERSIZE;
+  if (length > MAXDMALENGTH)
+    length = MAXDMALENGTH;
+  pendingDma.store(((uint32_t) count << 16) | length);
+}
+
+// One of the output profiles, the note latency is measured per profile
+void PolySynth::setOutputProfile(int profile) {
+  if ((profile < 0) || (profile >= CUSTOMPROFILE))
+    return;
+  const OutputProfile *toProfile = &OUTPUTPROFILES[profile];
+  setBlockSize(toProfile->blockSize);
+  setDmaBuffers(toProfile->dmaBuffers, toProfile->dmaLength);
+  outputProfile = profile;
+}
+
+// Takes effect at the start of a block, costs measured per block are scaled along
+void PolySynth::changeBlockSize(int size) {
+  voiceCost = (voiceCost * size) / blockSize;
+  blockSize = size;
+  profiler.setBlockMicros(((uint32_t) blockSize * 1000000UL) / SAMPLERATE);
+}
+
+// Adaptive block size: doubles at once under load, to save the fixed cost
+// per block, and halves after ADAPTIVEBLOCKS light blocks with few voices,
+// for the lowest latency.
+void PolySynth::updateBlockSize() {
+  if (!adaptiveBlockSize)
+    return;
+  if (adaptiveHold > 0) {
+    adaptiveHold--; // let the smoothed load follow the last change
+    return;
+  }
+  uint32_t load = governor.getLoad();
+  if ((load > ADAPTIVEGROWPERCENT) && (blockSize < BUFFERSIZE)) {
+    nextBlockSize = blockSize << 1;
+    adaptiveBlocks = 0;
+    adaptiveHold = ADAPTIVEHOLDBLOCKS;
+  } else
+  if ((load < ADAPTIVESHRINKPERCENT) && (renderedVoices <= ADAPTIVEFEWVOICES) &&
+      (blockSize > ADAPTIVEMINBLOCKSIZE)) {
+    if ((++adaptiveBlocks) >= ADAPTIVEBLOCKS) {
+      nextBlockSize = blockSize >> 1;
+      adaptiveBlocks = 0;
+      adaptiveHold = ADAPTIVEHOLDBLOCKS;
+    }
+  } else {
+    adaptiveBlocks = 0;
+  }
+}
+
+// Measured note on to output latency of each profile that was used
+void PolySynth::printLatency() {
+  for(int profile = 0; profile < NROFOUTPUTPROFILES; profile++) {
+    const LatencyStats *toStats = &latencyStats[profile];
+    if ((toStats->notes == 0) && (profile != outputProfile))
+      continue;
+    Serial.printf("%c %-11s notes:%lu latency avg:%luus max:%luus\n\r",
+      (profile == outputProfile) ? '*' : ' ', OUTPUTPROFILES[profile].name,
+      (unsigned long) toStats->notes,
+      (unsigned long) ((toStats->notes > 0) ? toStats->totalMicros / toStats->notes : 0),
+      (unsigned long) toStats->maxMicros);
+  }
+  Serial.printf("Block:%d samples%s, DMA %dx%d samples\n\r", blockSize,
+    adaptiveBlockSize ? " (adaptive)" : "", dmaBuffers, dmaLength);
+  char line[200];
+  for(int stage = 0; stage < LatencyTrace::NROFSTAGES; stage++) {
+    latencyTrace.format(stage, line, sizeof(line));
+    Serial.printf("%s\n\r", line);
+  }
+}
+
+PolySynth::MemoryStats PolySynth::getMemoryStats() const {
+  MemoryStats stats;
+  stats.tableBytes = waveFactory.getTableBytes();
+  stats.voiceBytes = voiceBytes;
+  stats.effectBytes = effectBytes;
+  stats.arenaBytes = arena.getSize();
+  stats.peakBytes = arena.getPeak();
+  stats.arenaChunks = arena.getNrOfChunks();
+  return stats;
+}
+
+void PolySynth::printMemory() {
+  MemoryStats stats = getMemoryStats();
+  Serial.printf("Memory: tables %u, voices %u, effects %u bytes, peak %u of %u arena bytes in %d chunks\n\r",
+    (unsigned) stats.tableBytes, (unsigned) stats.voiceBytes, (unsigned) stats.effectBytes,
+    (unsigned) stats.peakBytes, (unsigned) stats.arenaBytes, stats.arenaChunks);
+}
+
+void PolySynth::printStats() {
+  codecControl.printStats();
+  voiceAllocator.printStats();
+  profiler.printStats();
+  if (toOutputTask != NULL) {
+    const OutputPipeline::Stats &pipelineStats = outputPipeline.getStats();
+    Serial.printf("Pipeline depth:%d adds up to %luus, fill min:%d max:%d, underruns:%lu render waits:%lu\n\r",
+      outputPipeline.getDepth(), (unsigned long) outputPipeline.getAddedLatencyMicros(SAMPLERATE),
+      pipelineStats.minFill, pipelineStats.maxFill,
+      (unsigned long) pipelineStats.underruns, (unsigned long) pipelineStats.fullWaits);
+  }
+  Serial.printf("Voice cost:%lu.%luus per block, limit %s\n\r",
+    (unsigned long) (voiceCost >> 8), (unsigned long) (((voiceCost & 0xff) * 10) >> 8),
+    autoVoiceLimit ? "follows CPU" : "fixed");
+  governor.printStats();
+  printLatency();
+  limiter.printStats();
 }
\ No newline at end of file
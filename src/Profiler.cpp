@@ -0,0 +1,92 @@
+/*!
+ *  @file       Profiler.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+
+#include "Profiler.h"
+
+// -----------------------------------------------------------------------------
+static const char *SECTIONNAMES[Profiler::NROFSECTIONS] = { "voices", "effects", "output" };
+
+void Profiler::begin(uint32_t blockMicros) {
+    blockPeriod = blockMicros;
+    reset();
+}
+
+void Profiler::reset() {
+    for(int section = 0; section < NROFSECTIONS; section++) {
+      sections[section].last = 0;
+      sections[section].max = 0;
+      sections[section].total = 0;
+    }
+    blocks = 0;
+    maxBlock = 0;
+    totalBlock = 0;
+}
+
+void Profiler::startBlock() {
+    blockStart = micros();
+    mark = blockStart;
+    for(int section = 0; section < NROFSECTIONS; section++) {
+      sections[section].last = 0;
+    }
+}
+
+void Profiler::endSection(int section) {
+    uint32_t now = micros();
+    Section *toSection = &sections[section];
+    toSection->last += now - mark;
+    mark = now;
+}
+
+void Profiler::endBlock() {
+    lastBlock = mark - blockStart;
+    for(int section = 0; section < NROFSECTIONS; section++) {
+      Section *toSection = &sections[section];
+      toSection->total += toSection->last;
+      if (toSection->last > toSection->max)
+        toSection->max = toSection->last;
+    }
+    totalBlock += lastBlock;
+    if (lastBlock > maxBlock)
+      maxBlock = lastBlock;
+    blocks++;
+}
+
+// Average and maximum per section, and the load against the block period
+void Profiler::printStats() {
+    if (blocks == 0)
+      return;
+    for(int section = 0; section < NROFSECTIONS; section++) {
+      Serial.printf("Render %s avg:%luus max:%luus\n\r", SECTIONNAMES[section],
+        (unsigned long) (sections[section].total / blocks),
+        (unsigned long) sections[section].max);
+    }
+    uint32_t average = (uint32_t) (totalBlock / blocks);
+    Serial.printf("Render total avg:%luus max:%luus of %luus, load avg:%lu%% max:%lu%%\n\r",
+      (unsigned long) average, (unsigned long) maxBlock, (unsigned long) blockPeriod,
+      (unsigned long) ((average * 100) / blockPeriod), (unsigned long) ((maxBlock * 100) / blockPeriod));
+}
@@ -0,0 +1,169 @@
+/*!
+ *  @file       Reverb.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <math.h>
+
+#include "Reverb.h"
+#include "constants.h"
+
+// -----------------------------------------------------------------------------
+// Line lengths in ms, no common divisors so the echoes do not pile up
+static const float LINEMS[REVERBNROFLINES] = { 29.7f, 37.1f, 41.1f, 43.7f };
+static const float DIFFUSERMS[REVERBNROFDIFFUSERS] = { 5.0f, 1.7f };
+static const int MINLENGTH = 16;
+static const int32_t ALLPASSGAIN = 0x4000;  // Q15, 0.5
+static const int INPUTSHIFT = 2;            // input into the network at a quarter
+static const float MINTIMESECONDS = 0.2f;
+static const float MAXTIMESECONDS = 8.0f;
+
+// Rounded, a truncating multiply leaves a bias that the feedback builds up
+static inline int32_t multiplyQ15(int32_t value, int32_t gain) {
+    return (value * gain + 0x4000) >> 15;
+}
+
+// Lengths in samples for the rate, all scaled by the same factor to fit the budget
+void Reverb::lengths(int rate, size_t budget, int lineLengths[], int diffuserLengths[]) {
+    size_t bytesPerSample = COMPACTDELAYLINES ? sizeof(int16_t) : sizeof(int32_t);
+    float totalMs = 0;
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      totalMs += LINEMS[line];
+    }
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      totalMs += DIFFUSERMS[diffuser];
+    }
+    float scale = 1.0f;
+    float neededBytes = (totalMs * rate / 1000) * bytesPerSample;
+    if (neededBytes > budget)
+      scale = budget / neededBytes;
+
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      int length = (int) (LINEMS[line] * scale * rate / 1000) | 1; // odd
+      lineLengths[line] = (length < MINLENGTH) ? MINLENGTH + 1 : length;
+    }
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      int length = (int) (DIFFUSERMS[diffuser] * scale * rate / 1000) | 1;
+      diffuserLengths[diffuser] = (length < MINLENGTH) ? MINLENGTH + 1 : length;
+    }
+}
+
+// Arena size needed by begin(), at most the budget plus alignment
+size_t Reverb::arenaBytes(int rate, size_t budget) {
+    int lineLengths[REVERBNROFLINES];
+    int diffuserLengths[REVERBNROFDIFFUSERS];
+    lengths(rate, budget, lineLengths, diffuserLengths);
+    size_t bytesPerSample = COMPACTDELAYLINES ? sizeof(int16_t) : sizeof(int32_t);
+    size_t bytes = 0;
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      bytes += lineLengths[line] * bytesPerSample + Arena::ALIGNMENT;
+    }
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      bytes += diffuserLengths[diffuser] * bytesPerSample + Arena::ALIGNMENT;
+    }
+    return bytes;
+}
+
+bool Reverb::begin(Arena *toArena, int newRate, size_t budget) {
+    int lineLengths[REVERBNROFLINES];
+    int diffuserLengths[REVERBNROFDIFFUSERS];
+    rate = newRate;
+    lengths(rate, budget, lineLengths, diffuserLengths);
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      if (!lines[line].begin(toArena, lineLengths[line]))
+        return false;
+    }
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      if (!diffusers[diffuser].begin(toArena, diffuserLengths[diffuser]))
+        return false;
+    }
+    updateFeedback();
+    return true;
+}
+
+void Reverb::clear() {
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      lines[line].clear();
+      lowpass[line] = 0;
+    }
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      diffusers[diffuser].clear();
+    }
+}
+
+// Reverb time 0..127, squared from MINTIMESECONDS to MAXTIMESECONDS
+void Reverb::setTime(uint8_t value) {
+    float fraction = (value & 0x7f) / 127.0f;
+    timeSeconds = MINTIMESECONDS + (MAXTIMESECONDS - MINTIMESECONDS) * fraction * fraction;
+    updateFeedback();
+}
+
+// Damping 0..127, the low pass in the lines goes from open to 0.2
+void Reverb::setDamping(uint8_t value) {
+    lowpassCoefficient = 0x7fff - (((value & 0x7f) * 0x6666) / 127);
+}
+
+// Feedback per line for a 60 dB decay in timeSeconds
+void Reverb::updateFeedback() {
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      float seconds = (float) lines[line].getLength() / rate;
+      feedback[line] = (int32_t) (powf(10.0f, -3.0f * seconds / timeSeconds) * 0x8000);
+    }
+}
+
+// One sample at the rate of begin()
+void Reverb::process(int32_t input, int32_t *toLeft, int32_t *toRight) {
+    // Diffusion by all pass filters in series
+    int32_t sample = input >> INPUTSHIFT;
+    for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+      DelayLine *toDiffuser = &diffusers[diffuser];
+      int32_t delayed = toDiffuser->tap(toDiffuser->getLength() - 1);
+      int32_t fed = sample + multiplyQ15(delayed, ALLPASSGAIN);
+      toDiffuser->write(fed);
+      sample = delayed - multiplyQ15(fed, ALLPASSGAIN);
+    }
+
+    // Damped outputs of the lines
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      int32_t out = lines[line].tap(lines[line].getLength() - 1);
+      lowpass[line] += multiplyQ15(out - lowpass[line], lowpassCoefficient);
+    }
+
+    // Hadamard matrix, scaled by 1/2 so it keeps the energy
+    int32_t sum01 = lowpass[0] + lowpass[1];
+    int32_t difference01 = lowpass[0] - lowpass[1];
+    int32_t sum23 = lowpass[2] + lowpass[3];
+    int32_t difference23 = lowpass[2] - lowpass[3];
+    int32_t mixed[REVERBNROFLINES];
+    mixed[0] = (sum01 + sum23 + 1) >> 1;
+    mixed[1] = (difference01 + difference23 + 1) >> 1;
+    mixed[2] = (sum01 - sum23 + 1) >> 1;
+    mixed[3] = (difference01 - difference23 + 1) >> 1;
+    for(int line = 0; line < REVERBNROFLINES; line++) {
+      lines[line].write(sample + multiplyQ15(mixed[line], feedback[line]));
+    }
+
+    *toLeft = (lowpass[0] + lowpass[2]) >> 1;
+    *toRight = (lowpass[1] + lowpass[3]) >> 1;
+}
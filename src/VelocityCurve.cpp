@@ -0,0 +1,54 @@
+/*!
+ *  @file       VelocityCurve.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+#include <math.h>
+
+#include "VelocityCurve.h"
+#include "Gain.h"
+
+// -----------------------------------------------------------------------------
+static const double EXPONENTIALRANGEDB = 40.0;
+
+void VelocityCurves::begin() {
+    for(int velocity = 0; velocity < NROFVELOCITIES; velocity++) {
+      curves[LINEARCURVE][velocity] = (velocity * UNITYGAIN) / 127;
+
+      // Velocity 1 is EXPONENTIALRANGEDB below velocity 127
+      double db = ((velocity - 127) * EXPONENTIALRANGEDB) / 126.0;
+      curves[EXPONENTIALCURVE][velocity] = (velocity == 0) ? 0 : (uint16_t) (pow(10.0, db/20.0) * UNITYGAIN);
+
+      curves[FIXEDCURVE][velocity] = UNITYGAIN;
+      curves[CUSTOMCURVE][velocity] = curves[LINEARCURVE][velocity];
+    }
+}
+
+// Values 0..127 per velocity, 127 is full gain
+void VelocityCurves::setCustomCurve(const uint8_t values[NROFVELOCITIES]) {
+    for(int velocity = 0; velocity < NROFVELOCITIES; velocity++) {
+      curves[CUSTOMCURVE][velocity] = ((values[velocity] & 0x7f) * UNITYGAIN) / 127;
+    }
+}
@@ -0,0 +1,277 @@
+/*!
+ *  @file       VoiceAllocator.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <Arduino.h>
+
+#include "VoiceAllocator.h"
+
+// -----------------------------------------------------------------------------
+void VoiceAllocator::begin(WaveGenerator *toAllVoices, int nrOfAllVoices, MidiChannel *toAllChannels) {
+    toVoices = toAllVoices;
+    nrOfVoices = nrOfAllVoices;
+    toChannels = toAllChannels;
+
+    // all voices free
+    for(int word = 0; word < NROFVOICEMASKWORDS; word++) {
+      freeVoices[word] = 0;
+    }
+    for(int index = 0; index < nrOfVoices; index++) {
+      freeVoices[index >> 5] |= (1UL << (index & 31));
+    }
+    nrOfFreeVoices = nrOfVoices;
+    voiceLimit = nrOfVoices;
+
+    memset(owners, NOVOICE, sizeof(owners));
+}
+
+// Lowest free voice, found with a find-first-set per mask word
+WaveGenerator *VoiceAllocator::takeFreeVoice() {
+    for(int word = 0; word < NROFVOICEMASKWORDS; word++) {
+      uint32_t bits = freeVoices[word];
+      if (bits != 0) {
+        int bit = __builtin_ctz(bits);
+        freeVoices[word] = bits & (bits - 1); // clear lowest set bit
+        nrOfFreeVoices--;
+        return &toVoices[(word << 5) + bit];
+      }
+    }
+    return NULL;
+}
+
+void VoiceAllocator::setStealPolicy(int policy) {
+    stealPolicy = policy;
+}
+
+void VoiceAllocator::setVoiceLimit(int limit) {
+    if (limit < 1)
+      limit = 1;
+    if (limit > nrOfVoices)
+      limit = nrOfVoices;
+    voiceLimit = limit;
+}
+
+// Best voice to fade out while more voices play than the limit, voices
+// that already fade out count as gone. NULL when at or below the limit.
+WaveGenerator *VoiceAllocator::findExcessVoice() {
+    int fading = 0;
+    WaveGenerator *toBest = NULL;
+    for(int index = 0; index < nrOfVoices; index++) {
+      WaveGenerator *toCandidate = &toVoices[index];
+      if (!toCandidate->isActive())
+        continue;
+      if (toCandidate->isFadingOut() || toCandidate->hasPendingNote()) {
+        fading++;
+        continue;
+      }
+      if ((toBest == NULL) || isBetterVictim(toCandidate, toBest))
+        toBest = toCandidate;
+    }
+    if (getActiveVoices() - fading <= voiceLimit)
+      return NULL;
+    return toBest;
+}
+
+// Voices per channel when shared equally by the channels that are playing
+int VoiceAllocator::fairShare(int channelIndex) {
+    int activeChannels = 1;
+    for(int index = 0; index < NROFMIDICHANNELS; index++) {
+      if ((index != channelIndex) && (toChannels[index].activeVoices > 0))
+        activeChannels++;
+    }
+    return voiceLimit / activeChannels;
+}
+
+// A channel below its fair share may always take a free voice, above it
+// only when enough free voices remain for the other channels to reach theirs.
+bool VoiceAllocator::mayTakeFreeVoice(int channelIndex, int share) {
+    int freeBelowLimit = voiceLimit - getActiveVoices();
+    if (freeBelowLimit > nrOfFreeVoices)
+      freeBelowLimit = nrOfFreeVoices;
+    if (freeBelowLimit <= 0)
+      return false;
+    if (toChannels[channelIndex].activeVoices < share)
+      return true;
+
+    int owed = 0;
+    for(int index = 0; index < NROFMIDICHANNELS; index++) {
+      int activeVoices = toChannels[index].activeVoices;
+      if ((index != channelIndex) && (activeVoices > 0) && (activeVoices < share))
+        owed += share - activeVoices;
+    }
+    return (freeBelowLimit > owed);
+}
+
+// Returns a free voice for a new note of the channel. Returns NULL when
+// the note has to wait for a stolen voice (*toStolen is set) or is dropped.
+WaveGenerator *VoiceAllocator::allocate(int channelIndex, WaveGenerator **toStolen) {
+    *toStolen = NULL;
+    int share = fairShare(channelIndex);
+
+    if (mayTakeFreeVoice(channelIndex, share)) {
+      WaveGenerator *toVoice = takeFreeVoice();
+      toChannels[channelIndex].activeVoices++;
+      toVoice->startOrder = startCounter++;
+      stats.allocations++;
+      if (getActiveVoices() > stats.peakPolyphony)
+        stats.peakPolyphony = getActiveVoices();
+      return toVoice;
+    }
+
+    WaveGenerator *toVictim = NULL;
+    if (stealPolicy != STEALNONE)
+      toVictim = findVictim(channelIndex, share);
+    if (toVictim == NULL) {
+      stats.drops++;
+      return NULL;
+    }
+
+    // The voice counts for the new channel from now on, it plays the
+    // new note as soon as its fade out is done
+    toChannels[toVictim->channel].activeVoices--;
+    toChannels[channelIndex].activeVoices++;
+    stats.steals++;
+    *toStolen = toVictim;
+    return NULL;
+}
+
+// A channel at or above its fair share steals from itself, otherwise from
+// the channels above their share, or from any channel when there are none.
+WaveGenerator *VoiceAllocator::findVictim(int channelIndex, int share) {
+    bool ownVoices = (toChannels[channelIndex].activeVoices >= share);
+    bool anyChannel = true;
+    if (!ownVoices) {
+      for(int index = 0; index < NROFMIDICHANNELS; index++) {
+        if (toChannels[index].activeVoices > share)
+          anyChannel = false;
+      }
+    }
+
+    WaveGenerator *toBest = NULL;
+    for(int index = 0; index < nrOfVoices; index++) {
+      WaveGenerator *toCandidate = &toVoices[index];
+      if (!toCandidate->isActive() || toCandidate->hasPendingNote())
+        continue;
+      if (ownVoices) {
+        if (toCandidate->channel != channelIndex)
+          continue;
+      } else
+      if (!anyChannel) {
+        if (toChannels[toCandidate->channel].activeVoices <= share)
+          continue;
+      }
+      if ((toBest == NULL) || isBetterVictim(toCandidate, toBest))
+        toBest = toCandidate;
+    }
+    return toBest;
+}
+
+// Releasing voices go first, then voices held by a pedal after their note off
+int VoiceAllocator::stealClass(WaveGenerator *toVoice) {
+    if (toVoice->isReleasing())
+      return 0;
+    if (toChannels[toVoice->channel].sustained.test(toVoice->pitch))
+      return 1;
+    return 2;
+}
+
+// Lower steal class first, then the policy decides
+bool VoiceAllocator::isBetterVictim(WaveGenerator *toCandidate, WaveGenerator *toBest) {
+    int candidateClass = stealClass(toCandidate);
+    int bestClass = stealClass(toBest);
+    if (candidateClass != bestClass)
+      return (candidateClass < bestClass);
+
+    // Older voice, the start counter may wrap around
+    bool older = ((int32_t) (toCandidate->startOrder - toBest->startOrder) < 0);
+    switch(stealPolicy) {
+      case STEALQUIETEST: {
+        int32_t candidateLoudness = loudness(toCandidate);
+        int32_t bestLoudness = loudness(toBest);
+        if (candidateLoudness != bestLoudness)
+          return (candidateLoudness < bestLoudness);
+        return older;
+      }
+      case STEALLOWESTPRIORITY: {
+        uint8_t candidatePriority = toChannels[toCandidate->channel].priority;
+        uint8_t bestPriority = toChannels[toBest->channel].priority;
+        if (candidatePriority != bestPriority)
+          return (candidatePriority < bestPriority);
+        return older;
+      }
+    }
+    return older;
+}
+
+int32_t VoiceAllocator::loudness(WaveGenerator *toVoice) {
+    int32_t noteGain = (toChannels[toVoice->channel].gain * toVoice->velocityGain) >> 15;
+    return (noteGain * toVoice->getEnvelopeLevel()) >> 15;
+}
+
+void VoiceAllocator::freeVoice(WaveGenerator *toVoice) {
+    int index = toVoice - toVoices;
+    freeVoices[index >> 5] |= (1UL << (index & 31));
+    nrOfFreeVoices++;
+    toChannels[toVoice->channel].activeVoices--;
+    unassign(toVoice->channel, toVoice->pitch, toVoice);
+}
+
+WaveGenerator *VoiceAllocator::findVoice(int channelIndex, uint8_t pitch) {
+    uint8_t index = owners[channelIndex][pitch & 0x7f];
+    if (index == NOVOICE)
+      return NULL;
+    return &toVoices[index];
+}
+
+void VoiceAllocator::assign(int channelIndex, uint8_t pitch, WaveGenerator *toVoice) {
+    owners[channelIndex][pitch & 0x7f] = toVoice - toVoices;
+}
+
+// Only removes the entry when the voice still plays the note, a retriggered
+// note may already own another voice
+void VoiceAllocator::unassign(int channelIndex, uint8_t pitch, WaveGenerator *toVoice) {
+    uint8_t *toOwner = &owners[channelIndex][pitch & 0x7f];
+    if (*toOwner == (uint8_t) (toVoice - toVoices))
+      *toOwner = NOVOICE;
+}
+
+// The note waiting for a stolen voice ended before it started,
+// the voice counts for its old channel again
+void VoiceAllocator::cancelSteal(WaveGenerator *toVoice) {
+    toChannels[toVoice->pendingChannel].activeVoices--;
+    toChannels[toVoice->channel].activeVoices++;
+}
+
+// The stolen voice starts the note that was waiting for it
+void VoiceAllocator::takeOver(WaveGenerator *toVoice) {
+    toVoice->startOrder = startCounter++;
+}
+
+void VoiceAllocator::printStats() {
+    Serial.printf("Voices a:%lu s:%lu d:%lu peak:%d active:%d limit:%d of %d\n\r",
+      (unsigned long) stats.allocations, (unsigned long) stats.steals,
+      (unsigned long) stats.drops, stats.peakPolyphony, getActiveVoices(),
+      voiceLimit, nrOfVoices);
+}
@@ -0,0 +1,96 @@
+/*!
+ *  @file       VoiceFilter.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <math.h>
+
+#include "VoiceFilter.h"
+
+// -----------------------------------------------------------------------------
+static const int32_t FILTERONE = (int32_t) 1 << FILTERCOEFFICIENTBITS;
+static const double MAXRESONANCEQ = 20.0;  // Q at resonance 127
+static const double MINRESONANCEQ = 0.5;   // Q at resonance 0, no peak
+
+static inline int32_t multiply(int32_t coefficient, int32_t value) {
+    return (int32_t) (((int64_t) coefficient * value) >> FILTERCOEFFICIENTBITS);
+}
+
+// The filter is only stable up to about a sixth of the sample rate, higher
+// cutoff notes get the coefficient of that frequency
+void FilterTables::begin(int sampleRate) {
+    for(int note = 0; note < FILTERNROFNOTES; note++) {
+      double cutoffHz = 440.0 * pow(2.0, (note - 69) / 12.0);
+      double coefficient = 2.0 * sin(M_PI * cutoffHz / sampleRate);
+      if ((coefficient > 1.0) || (cutoffHz > sampleRate / 6.0))
+        coefficient = 1.0;
+      frequency[note] = (int32_t) (coefficient * FILTERONE);
+    }
+
+    // Q rises exponentially with the resonance controller
+    for(int resonance = 0; resonance < 128; resonance++) {
+      double q = MINRESONANCEQ * pow(MAXRESONANCEQ / MINRESONANCEQ, resonance / 127.0);
+      damping[resonance] = (int32_t) (FILTERONE / q);
+    }
+}
+
+// Cutoff is a MIDI note in 1/256 semitones
+int32_t FilterTables::getFrequency(int32_t cutoff) const {
+    if (cutoff <= 0)
+      return frequency[0];
+    int note = cutoff >> 8;
+    if (note >= FILTERNROFNOTES - 1)
+      return frequency[FILTERNROFNOTES - 1];
+    int32_t fraction = cutoff & 0xff;
+    return frequency[note] + (int32_t) (((int64_t) (frequency[note + 1] - frequency[note]) * fraction) >> 8);
+}
+
+// A filter that is switched on starts from silence
+void VoiceFilter::setEnabled(bool on) {
+    if (on && !enabled)
+      reset();
+    enabled = on;
+}
+
+// Keeps the damping below 2 - frequency, where the filter stays stable
+void VoiceFilter::setCoefficients(int32_t newFrequency, int32_t newDamping) {
+    frequency = newFrequency;
+    if (newDamping > 2 * FILTERONE - newFrequency)
+      newDamping = 2 * FILTERONE - newFrequency;
+    damping = newDamping;
+}
+
+// Filters the samples of one voice and adds the low pass output to the mix bus
+void VoiceFilter::process(const int32_t input[], int32_t mix[], int bufferSize) {
+    int32_t lowState = low;
+    int32_t bandState = band;
+    for(int index = 0; index < bufferSize; index++) {
+      lowState += multiply(frequency, bandState);
+      int32_t high = (input[index] << FILTERSTATEBITS) - lowState - multiply(damping, bandState);
+      bandState += multiply(frequency, high);
+      mix[index] += lowState >> FILTERSTATEBITS;
+    }
+    low = lowState;
+    band = bandState;
+}
@@ -32,27 +32,41 @@
 #include "WaveFactory.h"
 
 // -----------------------------------------------------------------------------
+// Phase increment that plays a quarter wave table of waveSize samples at frequency.
+// The table holds a truncated nr of samples, the fraction is taken up by the phase.
+static int32_t phaseIncrement(int waveSize, double frequency) {
+  return (int32_t) (((4.0 * waveSize * frequency) / SAMPLERATE) * 65536.0 + 0.5);
+}
+
+// Samples in the quarter wave table of a note
+static int tableSize(double frequency) {
+  return (SAMPLERATE/(frequency*4));
+}
+
+static double noteFrequency(int midiNoteNr) {
+  static const double base = 1.059463094; // 2 to power (1/12)
+  static const double tuningbase = 27.50; // A0=27.5hz
+  return tuningbase*pow(base, midiNoteNr-MINMIDINOTES);
+}
+
 static char *noteNames[NROFNOTESINOCTAVE] = {
   "A", "A#", "B", "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#"
 };
 
-// Generate sinus wave sample for one note, only the first quarter of the wave
+// Generate sinus wave sample for one note, only the first quarter of the wave.
+// Returns the nr of samples, 0 when the arena is full.
 int WaveFactory::makeSinusNote(
-    Note *toNote, double frequency, int midiNoteNr, 
+    Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
     char *toNoteName, int octaveNr
 ) {
-    int bufferSize = (SAMPLERATE/(frequency*4)); // number of samples for quarter of wave
-    uint32_t *buffer = (uint32_t *) malloc(bufferSize*4); // 4 bytes per sample
-    if (buffer == NULL) {
-      Serial.printf("ERROR: could not allocate memory.\n\r");
-      while(1); // halt
-    }
+    int bufferSize = tableSize(frequency); // number of samples for quarter of wave
+    uint32_t *buffer = (uint32_t *) toArena->allocate(bufferSize*4); // 4 bytes per sample
+    if (buffer == NULL)
+      return 0;
     double delta = (PI/2)/(double) bufferSize;
     double angle = 0;
 
-    // We want to generate 12 bit samples
-    // since we have a dynamic range of 16 bits and we want
-    // 16 simultanious waves to be added without possible clipping.
+    // Full scale 16 bit samples, the limiter takes care of large chords
     for(int  index = 0; index < bufferSize; index++) {
       double s = sin(angle)*TOP;
       uint32_t monoSample = s;
@@ -65,30 +79,23 @@ int WaveFactory::makeSinusNote(
     toNote->samples[0] = buffer;
     toNote->sampleSizes[0] = bufferSize;
 
-    double nrOfSamples = (SAMPLERATE/frequency);
-    double error = nrOfSamples - trunc(nrOfSamples);
-    // wave in 4 parts, per HALF wave sample error
-    // since we will compensate per HALF wave
-    uint32_t sampleError = (error*WAVEPARTERRORMAX); 
-    toNote->sampleErrors[0] = sampleError;
-
     return(bufferSize);
 }
 
 // Generate triangle wave sample for one note, only the first quarter of the wave
 int WaveFactory::makeTriangleNote(
-    Note *toNote, double frequency, int midiNoteNr, 
+    Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
     char *toNoteName, int octaveNr
 ) {
-    int bufferSize = (SAMPLERATE/(frequency*4)); // number of samples for quarter of wave
-    uint32_t *buffer = (uint32_t *) malloc(bufferSize*4); // 4 bytes per sample
+    int bufferSize = tableSize(frequency); // number of samples for quarter of wave
+    uint32_t *buffer = (uint32_t *) toArena->allocate(bufferSize*4); // 4 bytes per sample
+    if (buffer == NULL)
+      return 0;
   
     double upDelta = 1.0/(double) bufferSize; // Lineair progression from 0.0 to 1.0
     double upValue = 0.0;
 
-    // We want to generate 12 bit samples
-    // since we have a dynamic range of 16 bits and we want
-    // 16 simultanious waves to be added without possible clipping.
+    // Full scale 16 bit samples, the limiter takes care of large chords
     for(int  index = 0; index < bufferSize; index++) {
       uint32_t monoSample = (upValue*TOP);
       uint32_t v = (monoSample << 16) | monoSample;
@@ -99,28 +106,21 @@ int WaveFactory::makeTriangleNote(
     toNote->samples[1] = buffer;
     toNote->sampleSizes[1] = bufferSize;
 
-    double nrOfSamples = (SAMPLERATE/frequency);
-    double error = nrOfSamples - trunc(nrOfSamples);
-    // wave in 4 parts, per HALF wave sample error
-    // since we will compensate per HALF wave
-    uint32_t sampleError = (error*WAVEPARTERRORMAX); 
-    toNote->sampleErrors[1] = sampleError;
-
     return(bufferSize);
 }
 
 int WaveFactory::makeSquareNote(
-    Note *toNote, double frequency, int midiNoteNr, 
+    Arena *toArena, Note *toNote, double frequency, int midiNoteNr, 
     char *toNoteName, int octaveNr
 ) {
-    int bufferSize = (SAMPLERATE/(frequency*4)); // number of samples for quarter of wave
-    uint32_t *buffer = (uint32_t *) malloc(bufferSize*4); // 4 bytes per sample
+    int bufferSize = tableSize(frequency); // number of samples for quarter of wave
+    uint32_t *buffer = (uint32_t *) toArena->allocate(bufferSize*4); // 4 bytes per sample
+    if (buffer == NULL)
+      return 0;
   
     double upValue = 0.9;
 
-    // We want to generate 12 bit samples
-    // since we have a dynamic range of 16 bits and we want
-    // 16 simultanious waves to be added without possible clipping.
+    // Full scale 16 bit samples, the limiter takes care of large chords
     for(int  index = 0; index < bufferSize; index++) {
       uint32_t monoSample = (upValue*TOP);
       uint32_t v = (monoSample << 16) | monoSample;
@@ -130,35 +130,42 @@ int WaveFactory::makeSquareNote(
     toNote->samples[2] = buffer;
     toNote->sampleSizes[2] = bufferSize;
 
-    double nrOfSamples = (SAMPLERATE/frequency);
-    double error = nrOfSamples - trunc(nrOfSamples);
-    // wave in 4 parts, per HALF wave sample error
-    // since we will compensate per HALF wave
-    uint32_t sampleError = (error*WAVEPARTERRORMAX); 
-    toNote->sampleErrors[2] = sampleError;
-
     return(bufferSize);
 }
 
-void WaveFactory::begin() {
-  static const double base = 1.059463094; // 2 to power (1/12)
-  static const double tuningbase = 27.50; // A0=27.5hz
+// Arena size needed by begin(), the tables of the first octave
+size_t WaveFactory::arenaBytes() {
+  size_t bytes = 0;
+  for(int index = MINMIDINOTES; index < (MINMIDINOTES+NROFNOTESINOCTAVE); index++) {
+    bytes += NROFSTYLES * (tableSize(noteFrequency(index)) * 4 + Arena::ALIGNMENT);
+  }
+  return bytes;
+}
+
+// Takes the tables from the arena. When it is too small the tables that were
+// made are given back and getNote() finds no notes, so nothing plays.
+bool WaveFactory::begin(Arena *toArena) {
+  size_t mark = toArena->getUsed();
+  tableBytes = 0;
+  ready = false;
 
   // Fill first octave starting at the A0 note
-  unsigned long totalNrOfSamples = 0L;
   int octaveNr = 0;
   int noteCount = 9; // Start at A0 note for midi pitch nr 21
   for(int index = MINMIDINOTES; index < (MINMIDINOTES+NROFNOTESINOCTAVE); index++) {
-    double frequency = tuningbase*pow(base, index-MINMIDINOTES);
+    double frequency = noteFrequency(index);
     // Serial.printf("Note: %d Frequency:%f\n\r", index, frequency);
     char *toNoteName = noteNames[(index-MINMIDINOTES) % 12];
     // Make samples for the several types for each note
-    totalNrOfSamples += makeSinusNote(&notes[index], frequency, index, toNoteName, octaveNr);
-    totalNrOfSamples += makeTriangleNote(&notes[index], frequency, index, toNoteName, octaveNr);
-    totalNrOfSamples += makeSquareNote(&notes[index], frequency, index, toNoteName, octaveNr);
+    if ((makeSinusNote(toArena, &notes[index], frequency, index, toNoteName, octaveNr) == 0) ||
+        (makeTriangleNote(toArena, &notes[index], frequency, index, toNoteName, octaveNr) == 0) ||
+        (makeSquareNote(toArena, &notes[index], frequency, index, toNoteName, octaveNr) == 0)) {
+      toArena->release(mark);
+      return false;
+    }
 
     Note *toNote = &notes[index];
-    toNote->delta = 1;
+    toNote->phaseIncrement = phaseIncrement(toNote->sampleSizes[0], frequency);
     toNote->midiNoteNr = index;
     toNote->frequency = frequency;
     sprintf(toNote->name, "%s%d", toNoteName, octaveNr);
@@ -169,14 +176,13 @@ void WaveFactory::begin() {
       octaveNr++;
     }
   }
-  // Serial.printf("TotalNrOfSamples: %lu (%lu bytes)\n\r", totalNrOfSamples, totalNrOfSamples*4L);
+  tableBytes = toArena->getUsed() - mark;
 
-  // Fill next octaves using the 0 and 1 octave note samples and bigger deltas
-  int multiplier = 2; // double this for each octave
+  // Fill next octaves using the 0 and 1 octave note samples and bigger increments
   int baseCount = 0;
   Note *toBaseNote = &notes[MINMIDINOTES];
   for(int index = (MINMIDINOTES+NROFNOTESINOCTAVE); index <= MAXMIDINOTES; index++) {
-    double frequency = tuningbase*pow(base, index-MINMIDINOTES);
+    double frequency = noteFrequency(index);
     // Serial.printf("Note: %d Frequency:%f\n\r", index, frequency);
 
     Note *toNote = &notes[index];
@@ -185,7 +191,7 @@ void WaveFactory::begin() {
       toNote->samples[styleIndex] = toBaseNote->samples[styleIndex];
       toNote->sampleSizes[styleIndex] = toBaseNote->sampleSizes[styleIndex]; 
     }
-    toNote->delta = multiplier;
+    toNote->phaseIncrement = phaseIncrement(toBaseNote->sampleSizes[0], frequency);
     toNote->frequency = frequency;
     sprintf(toNote->name, "%s%d", noteNames[toBaseNote->midiNoteNr-MINMIDINOTES], octaveNr);
 
@@ -199,14 +205,14 @@ void WaveFactory::begin() {
     if (baseCount == NROFNOTESINOCTAVE) {
       baseCount = 0;
       toBaseNote = &notes[MINMIDINOTES];
-      multiplier = multiplier*2;
     }
   }
-  
+  ready = true;
+  return true;
 }
 
 Note *WaveFactory::getNote(int noteNr) {
-  if ((noteNr >= MINMIDINOTES) && (noteNr <= MAXMIDINOTES))
+  if (ready && (noteNr >= MINMIDINOTES) && (noteNr <= MAXMIDINOTES))
     return &notes[noteNr];
 
   return NULL;
@@ -33,247 +33,181 @@
 #include "constants.h"
 
 // -----------------------------------------------------------------------------
-void WaveGenerator::setWave(uint32_t wave[], int waveSize, int d, uint32_t error) {
+// Starts the wave at phase 0, increment is in quarter wave samples per output sample (Q16)
+void WaveGenerator::setWave(uint32_t wave[], int size, int32_t startIncrement) {
   toStartWave = wave;
-  toEndWave = wave + (waveSize - 1);
-  toWave = wave;
+  waveSize = size;
+  quarterLength = size << 16;
+  phase = 0;
   state = 1;
-  delta = d;
+  increment = limitIncrement(startIncrement);
+  targetIncrement = increment;
   stopping = false;
-  sampleError = error; // Calculated error per HALF wave
-  totalError = 0;
+  releasing = false;
+  fadingOut = false;
 }
 
-void WaveGenerator::clearWave() {
-  stopping = true; // soft stopping, wait until state 4 transit to state 1
+// Pitch for the next block, the increment glides there across the block
+void WaveGenerator::setTargetIncrement(int32_t newIncrement) {
+  targetIncrement = limitIncrement(newIncrement);
 }
 
-static inline uint32_t check(uint32_t invalue) {
-  uint32_t checkValue = invalue & 0xffff;
-  if (checkValue > (0xffff >> 1)) {
-    // pseudo negative
-    checkValue = 0xffff - checkValue;
-    if (checkValue > 0x1000) {
-      Serial.printf("ERROR: Sample overflow: %X\n\r", checkValue);
-    }
-  } else {
-    if (checkValue > 0x1000) {
-      Serial.printf("ERROR: Sample overflow: %X\n\r", checkValue);
-    }
+// An increment of a quarter of the wave or more per sample would skip past
+// the end of the quarter, so the table index would leave the table
+int32_t WaveGenerator::limitIncrement(int32_t newIncrement) {
+  if (newIncrement < 0)
+    return 0;
+  if (newIncrement >= quarterLength)
+    return quarterLength - 1;
+  return newIncrement;
+}
+
+// Starts the attack of a new note, returns the initial envelope level
+int32_t WaveGenerator::startEnvelope(int32_t attack) {
+  attackStep = attack;
+  releasing = false;
+  envelopeLevel = (attack >= UNITYGAIN) ? UNITYGAIN : 0;
+  envelope = envelopeLevel * BUFFERSIZE;
+  return envelopeLevel;
+}
+
+// Starts the release, without release time the wave stops at a zero crossing
+void WaveGenerator::release(int32_t release) {
+  if (release == 0) {
+    clearWave();
+    return;
   }
+  if (fadingOut && (releaseStep > release))
+    return;
+  releaseStep = release;
+  releasing = true;
+}
 
-  return invalue;
+// Fades out quickly, then the new note is started by the owner of the voice
+void WaveGenerator::steal(int32_t fadeStep, uint8_t newChannel, uint8_t newPitch, uint8_t newVelocity) {
+  pendingChannel = newChannel;
+  pendingPitch = newPitch;
+  pendingVelocity = newVelocity;
+  fadeOut(fadeStep);
 }
 
-// Returns true if sample generation stopped
-void WaveGenerator::setSamplesInBuffer(uint32_t buffer[], int bufferSize) {
-  int bufferIndex = 0;
-  while(bufferIndex < bufferSize) {
-    switch(state) {
-      // Idle state, just generate stereo 12 bits mean value all the time
-      case 0:
-        while(bufferIndex < bufferSize) {
-          buffer[bufferIndex] = STEREOBASE;
-          bufferIndex++;
-        }
-        break;
-      // In first quarter of wave generation
-      case 1:
-        // Serial.printf("State:1\n\r");
-        while((bufferIndex < bufferSize) && (toWave <= toEndWave)) {
-          buffer[bufferIndex] = *toWave;
-          bufferIndex++;
-          toWave = toWave + delta; // go forwards
-        }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          // End of first quarter reached, continue filling buffer
-          state = 2;
-          toWave = toEndWave;
-          // Find out if we need to add an  additional sample
-          totalError = totalError + sampleError;
-          if (totalError > WAVEPARTERRORMAX) {
-            state = 5;
-          }
-        }
-        break;
-      // In second quarter of wave generation
-      case 2:
-        // Serial.printf("State:2\n\r");
-        while((bufferIndex < bufferSize) && (toWave >= toStartWave)) {
-          buffer[bufferIndex] = *toWave;
-          bufferIndex++;
-          toWave = toWave - delta; // go backwards 
-        }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          if (stopping) {
-            state = 0; // Goto idle state
-          }
-          else {
-            state = 3; // next wave generation
-          }
-          toWave = toStartWave;
-        }
-        break;
-      // In third quarter of wave generation
-      case 3:
-        // Serial.printf("State:3\n\r");
-        while((bufferIndex < bufferSize) && (toWave <= toEndWave)) {
-          buffer[bufferIndex] = -(*toWave);
-          bufferIndex++;
-          toWave = toWave + delta;
-        }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          state = 4; // next wave generation
-          toWave = toEndWave;
-          // Find out if we need to add an  additional sample
-          totalError = totalError + sampleError;
-          if (totalError > WAVEPARTERRORMAX) {
-            state = 6;
-          }
-        }
-        break;
-      // In fourth quarter of wave generation
-      case 4:
-        // Serial.printf("State:4\n\r");
-        while((bufferIndex < bufferSize) && (toWave >= toStartWave)) {
-          buffer[bufferIndex] = -(*toWave);
-          bufferIndex++;
-          toWave = toWave - delta; // go backwards 
-        }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          state = 1; // next wave generation
-          toWave = toStartWave;
-        }
-        break;
-      case 5:
-        if (bufferIndex < bufferSize) {
-          // Add a sample to the buffer to compensate for HALF wave error
-          totalError = totalError - WAVEPARTERRORMAX;
-          buffer[bufferIndex] = *toEndWave;
-          bufferIndex++;
-          state = 2;
-        }
-        break;
-      case 6:
-        if (bufferIndex < bufferSize) {
-          // Add a sample to the buffer to compensate for HALF wave error
-          totalError = totalError - WAVEPARTERRORMAX;
-          buffer[bufferIndex] = -(*toEndWave);
-          bufferIndex++;
-          state = 4;
-        }
-        break;
-    }
+// Fades out quickly without a new note, the voice is freed when silent
+void WaveGenerator::fadeOut(int32_t fadeStep) {
+  if (!releasing || (releaseStep < fadeStep))
+    releaseStep = fadeStep;
+  releasing = true;
+  fadingOut = true;
+}
+
+// Next envelope level, called once per block before the samples are added.
+// Steps are per BUFFERSIZE samples, so envelope times do not depend on the
+// size of the block.
+int32_t WaveGenerator::advanceEnvelope(int bufferSize) {
+  static const int32_t FULLENVELOPE = UNITYGAIN * BUFFERSIZE;
+  if (releasing) {
+    envelope -= releaseStep * bufferSize;
+    if (envelope < 0)
+      envelope = 0;
+  } else
+  if (envelope < FULLENVELOPE) {
+    envelope += attackStep * bufferSize;
+    if (envelope > FULLENVELOPE)
+      envelope = FULLENVELOPE;
   }
+  envelopeLevel = envelope / BUFFERSIZE;
+  return envelopeLevel;
+}
+
+void WaveGenerator::clearWave() {
+  stopping = true; // soft stopping, wait until state 4 transit to state 1
 }
 
-void WaveGenerator::addSamplesToBuffer(uint32_t buffer[], int bufferSize) {
+// Table entries hold the same positive sample in both 16 bit halves
+static inline int32_t monoSample(uint32_t value) {
+  return (int32_t) (value & 0xffff);
+}
+
+// Adds the samples of this generator, scaled by its gain, to the mix bus.
+// The phase runs through the quarter wave table forwards and backwards,
+// the second half of the wave is the negated first half.
+void WaveGenerator::addSamplesToMix(int32_t mix[], int bufferSize) {
   int bufferIndex = 0;
+  int lastIndex = waveSize - 1;
+  int32_t incrementStep = (targetIncrement - increment) / bufferSize;
+  gain.beginBlock(bufferSize);
   while(bufferIndex < bufferSize) {
     switch(state) {
-      // Idle state, just generate stereo 12 bits mean value all the time
+      // Idle state, nothing to add
       case 0:
-        while(bufferIndex < bufferSize) {
-          buffer[bufferIndex] += STEREOBASE;
-          bufferIndex++;
-        }
+        bufferIndex = bufferSize;
         break;
       // In first quarter of wave generation
       case 1:
-        // Serial.printf("State:1\n\r");
-        while((bufferIndex < bufferSize) && (toWave <= toEndWave)) {
-          buffer[bufferIndex] += *toWave;
+        while((bufferIndex < bufferSize) && (phase < quarterLength)) {
+          mix[bufferIndex] += (monoSample(toStartWave[phase >> 16]) * gain.next()) >> 15;
           bufferIndex++;
-          toWave = toWave + delta; // go forwards
+          phase += increment; // go forwards
+          increment += incrementStep;
         }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          // End of first quarter reached, continue filling buffer
+        if (phase >= quarterLength) {
+          phase -= quarterLength;
           state = 2;
-          toWave = toEndWave;
-          // Find out if we need to add an  additional sample
-          totalError = totalError + sampleError;
-          if (totalError > WAVEPARTERRORMAX) {
-            state = 5;
-          }
         }
         break;
       // In second quarter of wave generation
       case 2:
-        // Serial.printf("State:2\n\r");
-        while((bufferIndex < bufferSize) && (toWave >= toStartWave)) {
-          buffer[bufferIndex] += *toWave;
+        while((bufferIndex < bufferSize) && (phase < quarterLength)) {
+          mix[bufferIndex] += (monoSample(toStartWave[lastIndex - (phase >> 16)]) * gain.next()) >> 15;
           bufferIndex++;
-          toWave = toWave - delta; // go backwards 
+          phase += increment; // go backwards
+          increment += incrementStep;
         }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
+        if (phase >= quarterLength) {
+          phase -= quarterLength;
           if (stopping) {
             state = 0; // Goto idle state
           }
           else {
             state = 3; // next wave generation
           }
-          toWave = toStartWave;
         }
         break;
       // In third quarter of wave generation
       case 3:
-        // Serial.printf("State:3\n\r");
-        while((bufferIndex < bufferSize) && (toWave <= toEndWave)) {
-          buffer[bufferIndex] += -(*toWave);
+        while((bufferIndex < bufferSize) && (phase < quarterLength)) {
+          mix[bufferIndex] -= (monoSample(toStartWave[phase >> 16]) * gain.next()) >> 15;
           bufferIndex++;
-          toWave = toWave + delta;
+          phase += increment;
+          increment += incrementStep;
         }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          state = 4; // next wave generation
-          toWave = toEndWave;
-          // Find out if we need to add an  additional sample
-          totalError = totalError + sampleError;
-          if (totalError > WAVEPARTERRORMAX) {
-            state = 6;
-          }
+        if (phase >= quarterLength) {
+          phase -= quarterLength;
+          state = 4;
         }
         break;
       // In fourth quarter of wave generation
       case 4:
-        // Serial.printf("State:4\n\r");
-        while((bufferIndex < bufferSize) && (toWave >= toStartWave)) {
-          buffer[bufferIndex] += -(*toWave);
+        while((bufferIndex < bufferSize) && (phase < quarterLength)) {
+          mix[bufferIndex] -= (monoSample(toStartWave[lastIndex - (phase >> 16)]) * gain.next()) >> 15;
           bufferIndex++;
-          toWave = toWave - delta; // go backwards 
-        }
-        // printBuffer(buffer, bufferIndex); // DEBUG
-        if (bufferIndex < bufferSize) {
-          state = 1; // next wave generation
-          toWave = toStartWave;
+          phase += increment; // go backwards
+          increment += incrementStep;
         }
-        break;
-      case 5:
-        if (bufferIndex < bufferSize) {
-          // Add a sample to the buffer to compensate for HALF wave error
-          totalError = totalError - WAVEPARTERRORMAX;
-          buffer[bufferIndex] += *toEndWave;
-          bufferIndex++;
-          state = 2;
-        }
-        break;
-      case 6:
-        if (bufferIndex < bufferSize) {
-          // Add a sample to the buffer to compensate for HALF wave error
-          totalError = totalError - WAVEPARTERRORMAX;
-          buffer[bufferIndex] += -(*toEndWave);
-          bufferIndex++;
-          state = 4;
+        if (phase >= quarterLength) {
+          phase -= quarterLength;
+          state = 1;
         }
         break;
     }
   }
+  gain.endBlock();
+  increment = targetIncrement;
+
+  // Release faded out completely, stop without waiting for a zero crossing
+  if (releasing && (envelopeLevel == 0)) {
+    state = 0;
+    stopping = true;
+  }
 }
 
 void WaveGenerator::printSamples(uint16_t *toSamples, int samplesSize) {
@@ -298,7 +232,7 @@ void WaveGenerator::printBuffer(uint32_t buffer[], int bufferSize) {
   Serial.printf("\n\r");
 }
 
-// Test if we have gone from state 4 to state 0 and want to stop
+// Test if we have gone from state 2 to state 0 and want to stop
 bool WaveGenerator::clearStopping() {
   if ((stopping) && (state == 0)) {
     stopping = false;
@@ -307,3 +241,14 @@ bool WaveGenerator::clearStopping() {
   return false; // no clear signal
 }
 
+bool WaveGenerator::isActive() {
+  return (state != 0);
+}
+
+void WaveGenerator::setGain(int32_t newGain) {
+  gain.set(newGain);
+}
+
+void WaveGenerator::setTargetGain(int32_t newGain) {
+  gain.setTarget(newGain);
+}
\ No newline at end of file
@@ -1,10 +1,26 @@
 #include <Arduino.h>
 #include <MIDI.h>
+#include <esp_partition.h>
 #include "PolySynth.h"
+#include "MidiRecorder.h"
+#include "MidiFilePlayer.h"
 
-MIDI_CREATE_INSTANCE(HardwareSerial, Serial2, MIDI);
+// SysEx messages up to 256 bytes, large enough for a custom velocity curve
+struct PolySynthMidiSettings : public midi::DefaultSettings
+{
+    static const unsigned SysExMaxSize = 256;
+};
+
+MIDI_CREATE_CUSTOM_INSTANCE(HardwareSerial, Serial2, MIDI, PolySynthMidiSettings);
+
+// Plays the Standard MIDI File in the "midi" flash partition through its own parser,
+// 'p' on the Serial port plays it, 'l' plays it in a loop and 's' stops it
+static MidiFilePlayer midiFilePlayer;
+MIDI_CREATE_CUSTOM_INSTANCE(MidiFilePlayer, midiFilePlayer, MIDIFILE, PolySynthMidiSettings);
 
 static PolySynth polysynth;
+static MidiRecorder midiRecorder; // every parsed message, 'd' on the Serial port dumps it
+static char traceLine[3 * 256 + 16]; // longest SysEx message as text
 
 // This function will be automatically called when a NoteOn is received.
 // It must be a void-returning function with the correct parameters,
@@ -12,29 +28,122 @@ static PolySynth polysynth;
 // http://arduinomidilib.fortyseveneffects.com/a00022.html
 void handleNoteOn(byte channel, byte pitch, byte velocity)
 {
-    polysynth.startNote(pitch, velocity);
+    polysynth.setMidiTimes(MIDI.getByteMicros(), MIDI.getParseMicros());
+    polysynth.startNote(channel, pitch, velocity);
+}
+
+void handleFileNoteOn(byte channel, byte pitch, byte velocity)
+{
+    polysynth.setMidiTimes(MIDIFILE.getByteMicros(), MIDIFILE.getParseMicros());
+    polysynth.startNote(channel, pitch, velocity);
+}
+
+// Clock for the MIDI time stamps, 0 means no time stamp
+uint32_t timestampMicros()
+{
+    return micros() | 1;
 }
 
 void handleNoteOff(byte channel, byte pitch, byte velocity)
 {
-    polysynth.stopNote(pitch, velocity);
+    polysynth.stopNote(channel, pitch, velocity);
+}
+
+void handleControlChange(byte channel, byte number, byte value)
+{
+    polysynth.controlChange(channel, number, value);
+}
+
+void handlePitchBend(byte channel, int bend)
+{
+    polysynth.pitchBend(channel, bend);
 }
 
 void handleProgramChange(byte channel, byte number)
 {
     Serial.printf("PrChg c:%d n:%d\n\r", channel, number);
-    if (number == 0) {
-      // Use sinus wave sounds (piano)
-      polysynth.setStyle(PolySynth::SINUSSTYLE);
-    } else
-    if (number == 18) {
-      // Use triangle wave sounds (organ)
-      polysynth.setStyle(PolySynth::TRIANGLESTYLE);
-    } else
-    if (number == 36) {
-      // Use square wave sounds (computer)
-      polysynth.setStyle(PolySynth::SQUARESTYLE);
-    } 
+    // Each channel has its own style:
+    // 0 = sinus wave sounds (piano), 18 = triangle wave sounds (organ),
+    // 36 = square wave sounds (computer)
+    polysynth.programChange(channel, number);
+}
+
+void handleSystemExclusive(byte *array, unsigned size)
+{
+    if (!polysynth.systemExclusive(array, size)) {
+      Serial.printf("SysEx ignored s:%u\n\r", size);
+    }
+}
+
+void handleClock()
+{
+    polysynth.midiClock();
+}
+
+// Records the message read() just parsed, at the sample clock of the next block
+template<class MidiPort>
+void recordMessage(const MidiPort &port)
+{
+    uint32_t sample = polysynth.getSampleClock();
+    midi::MidiType type = port.getType();
+    if (type == midi::SystemExclusive) {
+      midiRecorder.record(sample, port.getSysExArray(), port.getSysExArrayLength());
+      return;
+    }
+    uint8_t status = type;
+    if (type < midi::SystemExclusive)
+      status |= (port.getChannel() - 1) & 0x0f;
+    midiRecorder.record(sample, status, port.getData1(), port.getData2());
+}
+
+// Prints the recorded messages in the format tools/replay.cpp reads
+void dumpMidiTrace()
+{
+    Serial.printf("# polysynth voices:%d limit:%d profile:%d rate:%d\n\r",
+      polysynth.getNrOfVoices(), polysynth.getVoiceLimitSetting(),
+      polysynth.getOutputProfile(), SAMPLERATE);
+    Serial.printf("# %lu messages, %lu entries overwritten\n\r",
+      (unsigned long) midiRecorder.getMessages(), (unsigned long) midiRecorder.getOverwritten());
+    uint32_t position = midiRecorder.getFirst();
+    while (midiRecorder.format(&position, traceLine, sizeof(traceLine))) {
+      Serial.printf("%s\n\r", traceLine);
+    }
+    Serial.printf("# end\n\r");
+}
+
+// Maps the "midi" data partition, the file is read from flash as it plays
+bool openMidiPartition()
+{
+    const esp_partition_t *toPartition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "midi");
+    if (toPartition == NULL)
+      return false;
+    const void *toData;
+    spi_flash_mmap_handle_t handle;
+    if (esp_partition_mmap(toPartition, 0, toPartition->size, SPI_FLASH_MMAP_DATA,
+          &toData, &handle) != ESP_OK)
+      return false;
+    return midiFilePlayer.open((const uint8_t *) toData, toPartition->size);
+}
+
+// Commands on the Serial port
+void handleCommand(int command)
+{
+    switch(command) {
+      case 'd':
+        dumpMidiTrace();
+        break;
+      case 'p':
+      case 'l':
+        if (midiFilePlayer.isOpen())
+          midiFilePlayer.start(micros(), command == 'l');
+        else
+          Serial.printf("No MIDI file in the midi partition\n\r");
+        break;
+      case 's':
+        midiFilePlayer.stop();
+        break;
+    }
 }
 
 void setup() {  
@@ -46,16 +155,37 @@ void setup() {
   MIDI.setHandleNoteOn(handleNoteOn);  // Put only the name of the function
   MIDI.setHandleNoteOff(handleNoteOff);
   MIDI.setHandleProgramChange(handleProgramChange);
+  MIDI.setHandleControlChange(handleControlChange);
+  MIDI.setHandlePitchBend(handlePitchBend);
+  MIDI.setHandleSystemExclusive(handleSystemExclusive);
+  MIDI.setHandleClock(handleClock);
+  MIDI.setTimestampClock(timestampMicros);
 
-  // Initiate MIDI communications, listen to all channels
+  // Initiate MIDI communications, listen to all channels, each channel plays its own part
   MIDI.begin(MIDI_CHANNEL_OMNI);
 
+  // Same handlers for the MIDI file player
+  MIDIFILE.setHandleNoteOn(handleFileNoteOn);
+  MIDIFILE.setHandleNoteOff(handleNoteOff);
+  MIDIFILE.setHandleProgramChange(handleProgramChange);
+  MIDIFILE.setHandleControlChange(handleControlChange);
+  MIDIFILE.setHandlePitchBend(handlePitchBend);
+  MIDIFILE.setHandleSystemExclusive(handleSystemExclusive);
+  MIDIFILE.setTimestampClock(timestampMicros);
+  MIDIFILE.begin(MIDI_CHANNEL_OMNI);
+  if (openMidiPartition()) {
+    Serial.printf("MIDI file with %d tracks\n\r", midiFilePlayer.getNrOfTracks());
+  }
+
   // Serial2 is the MIDI port, MUST be opened AFTER the MIDI.begin)()
   uint32_t config = 134217756U;
   // Rx=IO21, TX=IO19 pins
   Serial2.begin(31250, config, GPIO_NUM_21, GPIO_NUM_19, false);
 
   polysynth.begin();
+  if (!midiRecorder.begin(MIDIRECORDERENTRIES)) {
+    Serial.printf("ERROR: No memory for the MIDI recorder\n\r");
+  }
   polysynth.setVolume(40);
 
   // polysynth.testGenerate(69, 69+3); // Debug A4 note, 440 hz and other note
@@ -63,7 +193,17 @@ void setup() {
 
 void loop() {
   // Check if something is on the MIDI input port
-  MIDI.read();
+  if (MIDI.read())
+    recordMessage(MIDI);
+  // Messages of the MIDI file that are due, all of them before the next block
+  midiFilePlayer.update(micros());
+  while (midiFilePlayer.available() > 0) {
+    if (MIDIFILE.read())
+      recordMessage(MIDIFILE);
+  }
+  // Commands on the log port
+  if (Serial.available() > 0)
+    handleCommand(Serial.read());
   // Generate tones (waves)
   polysynth.loop();
 }
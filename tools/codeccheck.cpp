@@ -0,0 +1,155 @@
+/*!
+ *  @file       codeccheck.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Bus traffic check of the AC101 driver, runs on Linux without the ESP32.
+//
+//   g++ -O2 -Iinclude -o codeccheck tools/codeccheck.cpp src/AC101.cpp src/AC101Bus.cpp
+//   ./codeccheck
+//
+// Runs the driver over AC101MockBus and checks the transaction counts of
+// the shadow registers and the batched writes: begin() writes every
+// register once, apart from the steps of the output power up, the counters
+// of the driver agree with the bus, a write of an unchanged register is
+// skipped and volume changes within a batch go out as one write per
+// register. Exits with 1 when a check fails.
+
+#include <stdio.h>
+
+#include "AC101.h"
+#include "AC101MockBus.h"
+
+// Register addresses of the checked registers, as in AC101.cpp
+static const uint8_t CHIPAUDIORS = 0x00;
+static const uint8_t I2S1LCKCTRL = 0x10;
+static const uint8_t HPOUTCTRL   = 0x56;
+static const uint8_t SPKOUTCTRL  = 0x58;
+
+// Writes of the power up sequence in SetMode(MODE_DAC), the stages ramp up
+// in steps that must reach the chip one after the other. The speaker output
+// is also configured before the sequence, that write goes out with the
+// first step.
+static const int HPOUTWRITES  = 3;
+static const int SPKOUTWRITES = 3;
+
+static int failed = 0;
+
+static void check(bool ok, const char *toWhat) {
+  printf("%-56s %s\n", toWhat, ok ? "ok" : "FAIL");
+  if (!ok)
+    failed++;
+}
+
+// Bus transactions and register writes done by one call
+struct Traffic {
+  uint32_t transactions;
+  uint32_t writes;
+  uint32_t reads;
+};
+
+static Traffic since(const AC101MockBus &bus, const Traffic &before) {
+  Traffic traffic;
+  traffic.transactions = bus.transactions - before.transactions;
+  traffic.writes = bus.registerWrites - before.writes;
+  traffic.reads = bus.registerReads - before.reads;
+  return traffic;
+}
+
+static Traffic now(const AC101MockBus &bus) {
+  Traffic traffic = { bus.transactions, bus.registerWrites, bus.registerReads };
+  return traffic;
+}
+
+int main() {
+  AC101MockBus bus;
+  AC101 codec(&bus);
+
+  check(codec.begin(), "begin() succeeds");
+  const AC101::Stats_t &init = codec.GetInitStats();
+  printf("  init: %lu transactions, %lu reads, %lu writes, %lu cached, %lu coalesced\n",
+    (unsigned long) init.transactions, (unsigned long) init.reads, (unsigned long) init.writes,
+    (unsigned long) init.cached, (unsigned long) init.coalesced);
+  check((init.transactions == bus.transactions) && (init.reads == bus.registerReads) &&
+    (init.writes == bus.registerWrites), "init stats match the bus");
+
+  int rewritten = 0;
+  for (int reg = 0; reg < 256; ++reg) {
+    int expected = 1;
+    if (reg == HPOUTCTRL)
+      expected = HPOUTWRITES;
+    else if (reg == SPKOUTCTRL)
+      expected = SPKOUTWRITES;
+    if (bus.writeCount[reg] > expected) {
+      printf("  register %02x written %d times\n", reg, bus.writeCount[reg]);
+      rewritten++;
+    }
+  }
+  check(rewritten == 0, "begin() writes each register once");
+  check((bus.writeCount[I2S1LCKCTRL] == 1) && (init.coalesced > 0), "I2S1LCK_CTRL field updates merge into one write");
+  check(bus.writeCount[CHIPAUDIORS] == 1, "one reset");
+  check(((bus.registers[HPOUTCTRL] >> 4) & 63) == 30, "headphone volume reaches the chip");
+
+  // The same volume again, served from the shadow registers
+  uint32_t skipped = codec.GetStats().skipped;
+  Traffic before = now(bus);
+  codec.SetVolumeHeadphone(30);
+  Traffic traffic = since(bus, before);
+  check((traffic.transactions == 0) && (codec.GetStats().skipped == skipped + 1), "unchanged volume is skipped");
+
+  // A new volume, the register is read from the shadow and written once
+  before = now(bus);
+  codec.SetVolumeHeadphone(40);
+  traffic = since(bus, before);
+  check((traffic.transactions == 1) && (traffic.writes == 1) && (traffic.reads == 0), "new volume is one write");
+  check(((bus.registers[HPOUTCTRL] >> 4) & 63) == 40, "new volume reaches the chip");
+
+  // Several volume changes in a batch, one write per register at the end
+  uint32_t coalesced = codec.GetStats().coalesced;
+  before = now(bus);
+  codec.BeginBatch();
+  codec.SetVolumeHeadphone(10);
+  codec.SetVolumeSpeaker(20);
+  codec.SetVolumeHeadphone(12);
+  codec.SetVolumeSpeaker(20);
+  Traffic batched = since(bus, before);
+  codec.EndBatch();
+  traffic = since(bus, before);
+  check(batched.transactions == 0, "nothing is sent inside a batch");
+  check((traffic.transactions == 2) && (traffic.writes == 2) && (traffic.reads == 0), "batch sends one write per register");
+  check(codec.GetStats().coalesced == coalesced + 2, "batch counts the merged writes");
+  check((((bus.registers[HPOUTCTRL] >> 4) & 63) == 12) && ((bus.registers[SPKOUTCTRL] & 31) == 10),
+    "last volumes of the batch reach the chip");
+
+  const AC101::Stats_t &stats = codec.GetStats();
+  check((stats.transactions == bus.transactions) && (stats.reads == bus.registerReads) &&
+    (stats.writes == bus.registerWrites), "driver stats match the bus");
+
+  if (failed > 0) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,134 @@
+/*!
+ *  @file       filterbench.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Host benchmark of the voice filter, runs on Linux without the ESP32.
+//
+//   g++ -O2 -Iinclude tools/filterbench.cpp src/VoiceFilter.cpp -o filterbench
+//   ./filterbench [target MHz, default 240] [host MHz, default 3000]
+//
+// Reports the cost of one filtered voice per sample at 48 kHz and 192 kHz
+// and how many filtered voices fit in one core, scaled by the clock ratio.
+// The scaling is only a first estimate, measure on the device to be sure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "VoiceFilter.h"
+
+static const int BLOCKSIZE = 256;
+static const int NROFVOICES = 16;
+static const int NROFBLOCKS = 20000;
+
+static int32_t input[NROFVOICES][BLOCKSIZE];
+static int32_t mix[BLOCKSIZE];
+
+// Rising saw of about the table amplitude, different pitch per voice
+static void fillInput() {
+  for(int voice = 0; voice < NROFVOICES; voice++) {
+    int period = 37 + voice * 11;
+    for(int index = 0; index < BLOCKSIZE; index++) {
+      input[voice][index] = ((index % period) * 4000) / period - 2000;
+    }
+  }
+}
+
+// Impulse response at full resonance must die out for every cutoff, down to
+// the few LSB limit cycle of the fixed point state
+static bool isStable(const FilterTables &tables) {
+  int32_t impulse[BLOCKSIZE];
+  int32_t out[BLOCKSIZE];
+  for(int note = 0; note < FILTERNROFNOTES; note++) {
+    VoiceFilter filter;
+    filter.setEnabled(true);
+    filter.setCoefficients(tables.getFrequency(note << 8), tables.getDamping(127));
+    memset(impulse, 0, sizeof(impulse));
+    impulse[0] = 2000;
+    int32_t peak = 0;
+    for(int block = 0; block < 400; block++) {
+      memset(out, 0, sizeof(out));
+      filter.process(impulse, out, BLOCKSIZE);
+      impulse[0] = 0;
+      peak = 0;
+      for(int index = 0; index < BLOCKSIZE; index++) {
+        int32_t value = abs(out[index]);
+        if (value > peak)
+          peak = value;
+      }
+    }
+    if (peak > 16) {
+      printf("  unstable at note %d, peak %d after 400 blocks\n", note, peak);
+      return false;
+    }
+  }
+  return true;
+}
+
+static void benchmark(int sampleRate, double targetMHz, double hostMHz) {
+  FilterTables tables;
+  tables.begin(sampleRate);
+  VoiceFilter filters[NROFVOICES];
+  for(int voice = 0; voice < NROFVOICES; voice++) {
+    filters[voice].setEnabled(true);
+  }
+
+  int64_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for(int block = 0; block < NROFBLOCKS; block++) {
+    memset(mix, 0, sizeof(mix));
+    for(int voice = 0; voice < NROFVOICES; voice++) {
+      // Coefficients once per block, as the synthesizer does
+      int32_t cutoff = ((40 + voice * 4) << 8) + (block & 0xfff);
+      filters[voice].setCoefficients(tables.getFrequency(cutoff), tables.getDamping(100));
+      filters[voice].process(input[voice], mix, BLOCKSIZE);
+    }
+    checksum += mix[block & (BLOCKSIZE - 1)];
+  }
+  auto stop = std::chrono::steady_clock::now();
+
+  double seconds = std::chrono::duration<double>(stop - start).count();
+  double voiceSamples = (double) NROFBLOCKS * BLOCKSIZE * NROFVOICES;
+  double hostNs = (seconds * 1e9) / voiceSamples;
+  double targetNs = hostNs * hostMHz / targetMHz;
+  double budgetNs = 1e9 / sampleRate;
+  printf("%6d Hz: %.2f ns per voice sample on host, about %.1f ns at %.0f MHz\n",
+    sampleRate, hostNs, targetNs, targetMHz);
+  printf("          %.1f%% of one core per filtered voice, about %d filtered voices per core\n",
+    100.0 * targetNs / budgetNs, (int) (budgetNs / targetNs));
+  printf("          stable at full resonance: %s (checksum %lld)\n",
+    isStable(tables) ? "yes" : "no", (long long) checksum);
+}
+
+int main(int argc, char *argv[]) {
+  double targetMHz = (argc > 1) ? atof(argv[1]) : 240.0;
+  double hostMHz = (argc > 2) ? atof(argv[2]) : 3000.0;
+  fillInput();
+  benchmark(48000, targetMHz, hostMHz);
+  benchmark(192000, targetMHz, hostMHz);
+  return 0;
+}
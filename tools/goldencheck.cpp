@@ -0,0 +1,348 @@
+/*!
+ *  @file       goldencheck.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Golden output check of the synthesizer, runs on Linux without the ESP32.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -Isrc -o goldencheck tools/goldencheck.cpp tools/hostsim/HostSim.cpp $(ls src/*.cpp | grep -v main.cpp)
+//   ./goldencheck              compare with the hashes in tools/golden.txt
+//   ./goldencheck -u           write the hashes of this build to tools/golden.txt
+//   ./goldencheck -r dir       save the output of every scenario in dir
+//   ./goldencheck -c dir       compare with the output saved in dir
+//
+// Renders fixed scenarios for every wave style and 1, 4, 16 and 64 voices,
+// with stolen voices, filters, pitch bend, vibrato and the sustain pedal,
+// and one scenario with all effects on. Render time does not count on the
+// virtual clock, so the voice limit, the governor and the block size never
+// follow the load and the output only depends on the code.
+//
+// The hashes must match bit for bit. Code that is allowed to change the
+// output a little, a cheaper interpolation or a new rounding, is checked
+// against renders saved with -r before the change. -c prints the largest
+// sample error and the RMS error of each scenario and fails above the
+// tolerances set with -m (default 0) and -e (default 0.0).
+//
+// The hashes hold for g++ on x86-64. Another compiler or math library may
+// round the wave tables differently, use -r and -c there.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include <Arduino.h>
+#include "PolySynth.h"
+#include "HostSim.h"
+
+static const int NROFBLOCKS = 600; // 0.8 s at 192 kHz in blocks of 256
+static const int VOICECOUNTS[] = { 1, 4, 16, 64 };
+static const int NROFVOICECOUNTS = sizeof(VOICECOUNTS) / sizeof(VOICECOUNTS[0]);
+static const char *STYLENAMES[] = { "sinus", "triangle", "square" };
+static const byte STYLEPROGRAMS[] = { 0, 18, 36 };
+
+// MIDI message at the start of a block
+struct Step {
+    int block;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+struct Scenario {
+    char name[32];
+    int voices;
+    byte program;
+    bool effects;
+    std::vector<Step> steps;
+};
+
+static std::vector<uint32_t> output; // stereo samples of the scenario being rendered
+
+static void blockWritten(const uint32_t *toSamples, int samples, uint64_t renderNanos) {
+    output.insert(output.end(), toSamples, toSamples + samples);
+}
+
+static void addStep(Scenario *toScenario, int block, uint8_t status, uint8_t data1, uint8_t data2) {
+    Step step = { block, status, data1, data2 };
+    toScenario->steps.push_back(step);
+}
+
+// Two more notes than voices, so voices are stolen, then the filter,
+// pitch bend, vibrato and the sustain pedal on the first channel while a
+// second channel keeps playing
+static Scenario makeScenario(int style, int voices) {
+    Scenario scenario;
+    snprintf(scenario.name, sizeof(scenario.name), "%s-%d", STYLENAMES[style], voices);
+    scenario.voices = voices;
+    scenario.program = STYLEPROGRAMS[style];
+    scenario.effects = false;
+
+    int notes = voices + 2;
+    if (notes > 24)
+      notes = 24;
+    for (int note = 0; note < notes; note++) {
+      uint8_t status = (note & 1) ? 0x91 : 0x90;
+      addStep(&scenario, note * 6, status, (uint8_t) (36 + note * 3), (uint8_t) (40 + (note * 37) % 88));
+    }
+    addStep(&scenario, 150, 0xB0, MidiChannel::CCCUTOFF, 70);
+    addStep(&scenario, 150, 0xB0, MidiChannel::CCRESONANCE, 100);
+    addStep(&scenario, 150, 0xB0, MidiChannel::CCFILTERENVELOPE, 90);
+    addStep(&scenario, 200, 0xE0, 0x00, 0x50);
+    addStep(&scenario, 220, 0xB0, MidiChannel::CCMODULATION, 100);
+    addStep(&scenario, 250, 0xB0, MidiChannel::CCSUSTAIN, 127);
+    for (int note = 0; note < notes; note++) {
+      uint8_t status = (note & 1) ? 0x81 : 0x80;
+      addStep(&scenario, 260 + note * 2, status, (uint8_t) (36 + note * 3), 0);
+    }
+    addStep(&scenario, 350, 0xB0, MidiChannel::CCSUSTAIN, 0);
+    addStep(&scenario, 400, 0x90, 69, 127);
+    addStep(&scenario, 450, 0x80, 69, 0);
+    return scenario;
+}
+
+// Chorus, delay and reverb on a short melody
+static Scenario makeEffectsScenario() {
+    Scenario scenario;
+    snprintf(scenario.name, sizeof(scenario.name), "effects-16");
+    scenario.voices = 16;
+    scenario.program = STYLEPROGRAMS[1];
+    scenario.effects = true;
+    for (int note = 0; note < 8; note++) {
+      addStep(&scenario, note * 30, 0x90, (uint8_t) (60 + note * 2), 100);
+      addStep(&scenario, note * 30 + 20, 0x80, (uint8_t) (60 + note * 2), 0);
+    }
+    return scenario;
+}
+
+static void sendStep(PolySynth *toSynth, const Step &step) {
+    byte channel = (step.status & 0x0f) + 1;
+    switch (step.status & 0xf0) {
+      case 0x80: toSynth->stopNote(channel, step.data1, step.data2); break;
+      case 0x90: toSynth->startNote(channel, step.data1, step.data2); break;
+      case 0xB0: toSynth->controlChange(channel, step.data1, step.data2); break;
+      case 0xE0: toSynth->pitchBend(channel, ((step.data2 << 7) | step.data1) - 8192); break;
+    }
+}
+
+static void render(const Scenario &scenario) {
+    output.clear();
+    // A new synthesizer for every scenario, nothing carries over
+    PolySynth *toSynth = new PolySynth();
+    toSynth->begin(scenario.voices, 1, 0);
+    toSynth->setVoiceLimit(scenario.voices);
+    toSynth->programChange(1, scenario.program);
+    toSynth->programChange(2, scenario.program);
+    if (scenario.effects) {
+      toSynth->setEffect(Effects::CHORUSLEVEL, 80);
+      toSynth->setEffect(Effects::CHORUSDEPTH, 64);
+      toSynth->setEffect(Effects::DELAYLEVEL, 60);
+      toSynth->setEffect(Effects::DELAYFEEDBACK, 70);
+      toSynth->setEffect(Effects::REVERBLEVEL, 70);
+      toSynth->setEffect(Effects::REVERBTIME, 64);
+    }
+    size_t next = 0;
+    for (int block = 0; block < NROFBLOCKS; block++) {
+      while ((next < scenario.steps.size()) && (scenario.steps[next].block <= block)) {
+        sendStep(toSynth, scenario.steps[next]);
+        next++;
+      }
+      toSynth->loop();
+    }
+    // Frees the arena with the wave tables, voices and delay lines
+    delete toSynth;
+}
+
+// FNV-1a over the bytes of the output
+static uint64_t hashOutput() {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t index = 0; index < output.size(); index++) {
+      uint32_t sample = output[index];
+      for (int part = 0; part < 4; part++) {
+        hash = (hash ^ (sample & 0xff)) * 1099511628211ULL;
+        sample >>= 8;
+      }
+    }
+    return hash;
+}
+
+// Largest sample error and RMS error of both channels against a saved render
+static bool compareOutput(const char *toFileName, int *toMaxError, double *toRmsError) {
+    FILE *toFile = fopen(toFileName, "rb");
+    if (toFile == NULL)
+      return false;
+    std::vector<uint32_t> reference(output.size() + 1);
+    size_t size = fread(reference.data(), sizeof(uint32_t), reference.size(), toFile);
+    fclose(toFile);
+    if (size != output.size())
+      return false;
+
+    int maxError = 0;
+    double sumSquares = 0;
+    for (size_t index = 0; index < output.size(); index++) {
+      for (int shift = 0; shift < 32; shift += 16) {
+        int error = abs((int16_t) (output[index] >> shift) - (int16_t) (reference[index] >> shift));
+        if (error > maxError)
+          maxError = error;
+        sumSquares += (double) error * error;
+      }
+    }
+    *toMaxError = maxError;
+    *toRmsError = sqrt(sumSquares / (output.size() * 2));
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: goldencheck [-g golden file] [-u] [-r dir | -c dir [-m max error] [-e rms error]]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    const char *toGoldenName = "tools/golden.txt";
+    const char *toSaveDir = NULL;
+    const char *toCompareDir = NULL;
+    bool update = false;
+    int maxErrorLimit = 0;
+    double rmsErrorLimit = 0.0;
+    int option;
+    while ((option = getopt(argc, argv, "g:ur:c:m:e:")) != -1) {
+      switch (option) {
+        case 'g': toGoldenName = optarg; break;
+        case 'u': update = true; break;
+        case 'r': toSaveDir = optarg; break;
+        case 'c': toCompareDir = optarg; break;
+        case 'm': maxErrorLimit = atoi(optarg); break;
+        case 'e': rmsErrorLimit = atof(optarg); break;
+        default: usage();
+      }
+    }
+    if ((optind != argc) || (toSaveDir && toCompareDir))
+      usage();
+
+    std::vector<Scenario> scenarios;
+    for (int style = 0; style < NROFSTYLES; style++) {
+      for (int count = 0; count < NROFVOICECOUNTS; count++) {
+        scenarios.push_back(makeScenario(style, VOICECOUNTS[count]));
+      }
+    }
+    scenarios.push_back(makeEffectsScenario());
+
+    // Golden hashes, name and hash per line
+    std::vector<std::pair<std::string, uint64_t>> golden;
+    if (!update && !toSaveDir && !toCompareDir) {
+      FILE *toGolden = fopen(toGoldenName, "r");
+      if (toGolden == NULL) {
+        fprintf(stderr, "goldencheck: cannot read %s\n", toGoldenName);
+        return 2;
+      }
+      char line[128];
+      while (fgets(line, sizeof(line), toGolden) != NULL) {
+        char name[64];
+        unsigned long long hash;
+        if ((line[0] != '#') && (sscanf(line, "%63s %llx", name, &hash) == 2))
+          golden.push_back(std::make_pair(std::string(name), (uint64_t) hash));
+      }
+      fclose(toGolden);
+    }
+
+    // Render time does not move the virtual clock
+    hostSim.setCpuScale(0);
+    hostSim.setWriteHook(blockWritten);
+
+    FILE *toUpdate = NULL;
+    if (update) {
+      toUpdate = fopen(toGoldenName, "w");
+      if (toUpdate == NULL) {
+        fprintf(stderr, "goldencheck: cannot write %s\n", toGoldenName);
+        return 2;
+      }
+      fprintf(toUpdate, "# Output hashes of tools/goldencheck.cpp, written by goldencheck -u\n");
+    }
+
+    int failed = 0;
+    for (size_t index = 0; index < scenarios.size(); index++) {
+      const Scenario &scenario = scenarios[index];
+      render(scenario);
+      uint64_t hash = hashOutput();
+      char fileName[512];
+      if (toSaveDir || toCompareDir) {
+        snprintf(fileName, sizeof(fileName), "%s/%s.raw", toSaveDir ? toSaveDir : toCompareDir, scenario.name);
+      }
+
+      if (toUpdate != NULL) {
+        fprintf(toUpdate, "%s %016llx\n", scenario.name, (unsigned long long) hash);
+        printf("%-12s %016llx\n", scenario.name, (unsigned long long) hash);
+      } else
+      if (toSaveDir != NULL) {
+        FILE *toFile = fopen(fileName, "wb");
+        if ((toFile == NULL) || (fwrite(output.data(), sizeof(uint32_t), output.size(), toFile) != output.size())) {
+          fprintf(stderr, "goldencheck: cannot write %s\n", fileName);
+          return 2;
+        }
+        fclose(toFile);
+        printf("%-12s saved, %d samples\n", scenario.name, (int) output.size());
+      } else
+      if (toCompareDir != NULL) {
+        int maxError;
+        double rmsError;
+        if (!compareOutput(fileName, &maxError, &rmsError)) {
+          printf("%-12s FAIL no saved render of the same length\n", scenario.name);
+          failed++;
+          continue;
+        }
+        bool ok = (maxError <= maxErrorLimit) && (rmsError <= rmsErrorLimit);
+        printf("%-12s %s max error:%d rms error:%.4f\n", scenario.name, ok ? "ok  " : "FAIL", maxError, rmsError);
+        if (!ok)
+          failed++;
+      } else {
+        bool found = false;
+        uint64_t expected = 0;
+        for (size_t entry = 0; entry < golden.size(); entry++) {
+          if (golden[entry].first == scenario.name) {
+            found = true;
+            expected = golden[entry].second;
+          }
+        }
+        bool ok = found && (hash == expected);
+        if (!found)
+          printf("%-12s FAIL no golden hash\n", scenario.name);
+        else
+          printf("%-12s %s %016llx\n", scenario.name, ok ? "ok  " : "FAIL", (unsigned long long) hash);
+        if (!ok)
+          failed++;
+      }
+    }
+    if (toUpdate != NULL)
+      fclose(toUpdate);
+
+    if (failed > 0) {
+      printf("%d of %d scenarios changed\n", failed, (int) scenarios.size());
+      return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,135 @@
+/*!
+ *  @file       heapcheck.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Memory check of the arena on the heap of the ESP32, runs on Linux.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -Isrc -o heapcheck tools/heapcheck.cpp tools/hostsim/HostSim.cpp $(ls src/*.cpp | grep -v main.cpp)
+//   ./heapcheck
+//
+// Starts the synthesizer on heaps that are free in regions, as the internal
+// RAM of the ESP32, where no malloc can span two regions. The device heap
+// is the free internal RAM of a sketch when polysynth.begin() runs, its
+// largest free block is about 110 KB while the arena needs more than
+// twice that. The tables and voices must fit in chunks and play the same
+// audio as from one block, the effects get what is left. On a
+// heap too small for the tables and voices no notes play, the error shows
+// the largest free block. Exits with 1 when a heap does not give that.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <Arduino.h>
+#include "PolySynth.h"
+#include "HostSim.h"
+
+static const int NROFBLOCKS = 300;
+static const int VOICES = NROFWAVEGENERATORS;
+
+struct Heap {
+    const char *name;
+    size_t regions[16];
+    int nrOfRegions;
+    bool playsNotes;
+};
+
+// Free internal 8 bit RAM in each region: the reclaimed ROM data at
+// 0x3FFAE000, DRAM behind .bss, the startup stack at 0x3FFE0000 and the
+// top of DRAM at 0x3FFE4000
+static const Heap HEAPS[] = {
+    { "device",     { 6432, 91 * 1024, 15072, 110 * 1024 }, 4, true },
+    { "fragmented", { 24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024,
+                      24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024, 24 * 1024 }, 12, true },
+    { "too small",  { 100 * 1024, 50 * 1024 }, 2, false },
+};
+static const int NROFHEAPS = sizeof(HEAPS) / sizeof(HEAPS[0]);
+
+static uint64_t hash;
+
+// FNV-1a over the bytes of the output
+static void blockWritten(const uint32_t *toSamples, int samples, uint64_t renderNanos) {
+    for (int index = 0; index < samples; index++) {
+      uint32_t sample = toSamples[index];
+      for (int part = 0; part < 4; part++) {
+        hash = (hash ^ (sample & 0xff)) * 1099511628211ULL;
+        sample >>= 8;
+      }
+    }
+}
+
+// A chord over the range of the tables, the effects stay at level 0
+static PolySynth::MemoryStats render(int *toVoices) {
+    hash = 14695981039346656037ULL;
+    PolySynth *toSynth = new PolySynth();
+    toSynth->begin(VOICES, 1, 0);
+    for (int note = 0; note < 8; note++) {
+      toSynth->startNote(1, (byte) (24 + note * 9), 100);
+    }
+    for (int block = 0; block < NROFBLOCKS; block++) {
+      toSynth->loop();
+    }
+    *toVoices = toSynth->getNrOfVoices();
+    PolySynth::MemoryStats stats = toSynth->getMemoryStats();
+    delete toSynth;
+    return stats;
+}
+
+int main() {
+    hostSim.setCpuScale(0);
+    hostSim.setWriteHook(blockWritten);
+
+    int voices;
+    PolySynth::MemoryStats reference = render(&voices);
+    uint64_t referenceHash = hash;
+    printf("%-11s %7s %6s %6s %7s %6s %7s\n", "heap", "largest", "chunks", "voices", "tables", "effects", "audio");
+    printf("%-11s %7s %6d %6d %7u %7u %7s\n", "unlimited", "-", reference.arenaChunks, voices,
+      (unsigned) reference.tableBytes, (unsigned) reference.effectBytes, "ok");
+
+    int failed = 0;
+    for (int index = 0; index < NROFHEAPS; index++) {
+      const Heap &heap = HEAPS[index];
+      hostSim.setHeapRegions(heap.regions, heap.nrOfRegions);
+      size_t largest = hostSim.getLargestFreeBlock();
+      // The error with the largest free block is part of the check
+      hostSim.serialEcho = !heap.playsNotes;
+      PolySynth::MemoryStats stats = render(&voices);
+      hostSim.serialEcho = false;
+
+      bool ok;
+      if (heap.playsNotes)
+        ok = (voices == VOICES) && (stats.tableBytes > 0) && (hash == referenceHash);
+      else
+        ok = (voices == 0) && (stats.tableBytes == 0);
+      printf("%-11s %7u %6d %6d %7u %7u %7s\n", heap.name, (unsigned) largest, stats.arenaChunks, voices,
+        (unsigned) stats.tableBytes, (unsigned) stats.effectBytes,
+        !heap.playsNotes ? "-" : (hash == referenceHash) ? "ok" : "differs");
+      if (!ok) {
+        printf("FAIL %s heap\n", heap.name);
+        failed++;
+      }
+    }
+    return (failed > 0) ? 1 : 0;
+}
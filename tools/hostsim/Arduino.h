@@ -0,0 +1,51 @@
+// Host stand-in for the Arduino core, used by tools/rtsim.cpp.
+// Time is the virtual clock of HostSim, Serial goes to stdout.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+
+#define PI 3.1415926535897932384626433832795
+#define HEX 16
+#define DEC 10
+#define OUTPUT 1
+#define HIGH 1
+#define LOW 0
+
+enum { GPIO_NUM_19 = 19, GPIO_NUM_21 = 21, GPIO_NUM_22 = 22 };
+
+class HardwareSerial
+{
+public:
+    void begin(long baud, uint32_t config = 0, int rxPin = -1, int txPin = -1, bool invert = false) {}
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void print(const char *text);
+    void print(long value, int base = DEC);
+    void println(const char *text);
+    void println(long value, int base = DEC);
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t value) { return 1; }
+    size_t write(const uint8_t *buffer, size_t size) { return size; }
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint32_t micros();
+uint32_t millis();
+void pinMode(int pin, int mode);
+void digitalWrite(int pin, int value);
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
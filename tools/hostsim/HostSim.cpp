@@ -0,0 +1,389 @@
+/*!
+ *  @file       HostSim.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Virtual clock, DMA model and the platform functions the synthesizer
+// calls in the host simulation, see tools/rtsim.cpp.
+
+#include <stdarg.h>
+#include <time.h>
+
+#include "Arduino.h"
+#include "Wire.h"
+#include "driver/i2s.h"
+#include "esp_heap_caps.h"
+#include "HostSim.h"
+
+HostSim hostSim;
+HardwareSerial Serial;
+HardwareSerial Serial2;
+TwoWire Wire;
+
+// -----------------------------------------------------------------------------
+
+// CPU time of the thread, time the host spends on other processes does not count
+uint64_t HostSim::hostNanos() const {
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return (uint64_t) time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+uint64_t HostSim::samplesToNanos(double samples) const {
+    return (uint64_t) ((samples * 1e9) / sampleRate);
+}
+
+uint64_t HostSim::now() {
+    if (!running)
+      return virtualBase;
+    if (hostMark == 0)
+      hostMark = hostNanos();
+    return virtualBase + (uint64_t) ((hostNanos() - hostMark) * cpuScale);
+}
+
+void HostSim::pause() {
+    if (!running)
+      return;
+    virtualBase = now();
+    running = false;
+}
+
+void HostSim::resume() {
+    if (running)
+      return;
+    hostMark = hostNanos();
+    running = true;
+}
+
+void HostSim::advance(uint64_t nanos) {
+    virtualBase = now() + nanos;
+    hostMark = hostNanos();
+}
+
+void HostSim::install(int nrOfBuffers, int bufferLength, int rate) {
+    capacity = nrOfBuffers * bufferLength;
+    sampleRate = rate;
+    playing = false;
+}
+
+void HostSim::uninstall() {
+    bool wasRunning = running;
+    pause();
+    Event event = { REINSTALL, now(), 0, 0, 0 };
+    events.push_back(event);
+    playing = false;
+    if (wasRunning)
+      resume();
+}
+
+// A region is taken as one free block, the first that fits gets the bytes
+void HostSim::setHeapRegions(const size_t *toSizes, int nrOfRegions) {
+    heapModel = true;
+    heapRegions.assign(toSizes, toSizes + nrOfRegions);
+}
+
+void *HostSim::heapAlloc(size_t bytes) {
+    if (!heapModel)
+      return malloc(bytes);
+    for (size_t region = 0; region < heapRegions.size(); region++) {
+      if (heapRegions[region] >= bytes) {
+        void *toMemory = malloc(bytes);
+        if (toMemory == NULL)
+          return NULL;
+        heapRegions[region] -= bytes;
+        HeapBlock block = { toMemory, (int) region, bytes };
+        heapBlocks.push_back(block);
+        return toMemory;
+      }
+    }
+    return NULL;
+}
+
+void HostSim::heapFree(void *toMemory) {
+    for (size_t index = 0; index < heapBlocks.size(); index++) {
+      if (heapBlocks[index].toMemory == toMemory) {
+        heapRegions[heapBlocks[index].region] += heapBlocks[index].bytes;
+        heapBlocks.erase(heapBlocks.begin() + index);
+        break;
+      }
+    }
+    free(toMemory);
+}
+
+size_t HostSim::getLargestFreeBlock() const {
+    if (!heapModel)
+      return (size_t) -1;
+    size_t largest = 0;
+    for (size_t region = 0; region < heapRegions.size(); region++) {
+      if (heapRegions[region] > largest)
+        largest = heapRegions[region];
+    }
+    return largest;
+}
+
+// Queues a block, waits while the DMA buffers are full
+void HostSim::write(const uint32_t *toSamples, int samples) {
+    pause();
+    uint64_t nanos = now();
+    double position = ((double) nanos * sampleRate) / 1e9;
+    Event event = { UNDERRUN, nanos, 0, samples, 0 };
+    if (playing) {
+      event.renderNanos = nanos - lastReturn;
+      stats.totalRenderNanos += event.renderNanos;
+      if (event.renderNanos > stats.maxRenderNanos)
+        stats.maxRenderNanos = event.renderNanos;
+      if (queueEnd < position) {
+        event.gapSamples = (int) (position - queueEnd);
+        stats.underruns++;
+        stats.gapSamples += event.gapSamples;
+        events.push_back(event);
+        queueEnd = position;
+      } else
+      if (event.renderNanos * 100 > samplesToNanos(samples) * spikePercent) {
+        event.type = SPIKE;
+        stats.spikes++;
+        events.push_back(event);
+      }
+      int headroom = (int) (queueEnd - position);
+      if ((stats.blocks == 0) || (headroom < stats.minHeadroom))
+        stats.minHeadroom = headroom;
+      stats.blocks++;
+    } else {
+      // DMA starts with the first block
+      playing = true;
+      queueEnd = position;
+    }
+    if (writeHook != NULL)
+      writeHook(toSamples, samples, event.renderNanos);
+
+    double queued = queueEnd - position;
+    if (queued + samples > capacity) {
+      // Wait until the DMA has played enough for this block
+      double until = queueEnd + samples - capacity;
+      virtualBase = samplesToNanos(until);
+    }
+    queueEnd += samples;
+    lastReturn = now();
+    resume();
+}
+
+// -----------------------------------------------------------------------------
+// Arduino
+
+int HardwareSerial::printf(const char *format, ...) {
+    char text[256];
+    va_list arguments;
+    va_start(arguments, format);
+    int size = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    if (hostSim.serialEcho) {
+      // The formatting counts as device time, the terminal does not
+      hostSim.pause();
+      for (char *toChar = text; *toChar != 0; toChar++) {
+        if (*toChar != '\r')
+          fputc(*toChar, stdout);
+      }
+      hostSim.resume();
+    }
+    return size;
+}
+
+void HardwareSerial::print(const char *text) {
+    printf("%s", text);
+}
+
+void HardwareSerial::print(long value, int base) {
+    printf((base == HEX) ? "%lx" : "%ld", value);
+}
+
+void HardwareSerial::println(const char *text) {
+    printf("%s\n", text);
+}
+
+void HardwareSerial::println(long value, int base) {
+    printf((base == HEX) ? "%lx\n" : "%ld\n", value);
+}
+
+void delay(uint32_t ms) {
+    hostSim.advance((uint64_t) ms * 1000000ULL);
+}
+
+void delayMicroseconds(uint32_t us) {
+    hostSim.advance((uint64_t) us * 1000ULL);
+}
+
+uint32_t micros() {
+    return (uint32_t) (hostSim.now() / 1000);
+}
+
+uint32_t millis() {
+    return (uint32_t) (hostSim.now() / 1000000);
+}
+
+void pinMode(int pin, int mode) {
+}
+
+void digitalWrite(int pin, int value) {
+}
+
+// -----------------------------------------------------------------------------
+// Wire, 9 clocks per byte on the bus
+
+void TwoWire::advance(int bytes) {
+    hostSim.advance(((uint64_t) bytes * 9 * 1000000000ULL) / frequency);
+}
+
+bool TwoWire::begin(int sda, int scl, uint32_t busFrequency) {
+    frequency = busFrequency ? busFrequency : 400000;
+    return true;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    transmitSize = 0;
+}
+
+size_t TwoWire::write(uint8_t value) {
+    if (transmitSize >= (int) sizeof(transmit))
+      return 0;
+    transmit[transmitSize++] = value;
+    return 1;
+}
+
+// Register number followed by 16 bit values, big endian
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    if (transmitSize == 0)
+      return 0;
+    advance(2 + transmitSize);
+    uint8_t reg = transmit[0];
+    selected = reg;
+    for (int index = 1; index + 1 < transmitSize; index += 2) {
+      uint16_t value = (uint16_t) ((transmit[index] << 8) | transmit[index + 1]);
+      if ((reg == 0x00) && (value == 0x123)) {
+        memset(registers, 0, sizeof(registers));
+        registers[0x00] = 0x0101;
+      } else {
+        registers[reg] = value;
+      }
+      reg++;
+    }
+    transmitSize = 0;
+    return 0;
+}
+
+uint8_t TwoWire::requestFrom(uint16_t address, uint8_t size, bool sendStop) {
+    advance(3);
+    receive[0] = (uint8_t) (registers[selected] >> 8);
+    receive[1] = (uint8_t) registers[selected];
+    receiveSize = (size < 2) ? size : 2;
+    receiveIndex = 0;
+    return (uint8_t) receiveSize;
+}
+
+int TwoWire::read() {
+    if (receiveIndex >= receiveSize)
+      return -1;
+    return receive[receiveIndex++];
+}
+
+// -----------------------------------------------------------------------------
+// FreeRTOS, no tasks
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackSize,
+  void *parameter, UBaseType_t priority, TaskHandle_t *toHandle, BaseType_t core) {
+    return pdFAIL;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks * portTICK_PERIOD_MS);
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return NULL;
+}
+
+BaseType_t xPortGetCoreID() {
+    return 1;
+}
+
+void taskYIELD() {
+}
+
+// -----------------------------------------------------------------------------
+// Heap
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return hostSim.heapAlloc(size);
+}
+
+void heap_caps_free(void *toMemory) {
+    hostSim.heapFree(toMemory);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    return hostSim.getLargestFreeBlock();
+}
+
+// -----------------------------------------------------------------------------
+// I2S
+
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t *pins) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queueSize, void *queue) {
+    hostSim.install(config->dma_buf_count, config->dma_buf_len, config->sample_rate);
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t port) {
+    hostSim.uninstall();
+    return ESP_OK;
+}
+
+esp_err_t i2s_start(i2s_port_t port) {
+    return ESP_OK;
+}
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port) {
+    return ESP_OK;
+}
+
+// Stereo 16 bit, 4 bytes per sample
+esp_err_t i2s_write(i2s_port_t port, const void *source, size_t size, size_t *written, uint32_t ticksToWait) {
+    hostSim.write((const uint32_t *) source, (int) (size / 4));
+    *written = size;
+    return ESP_OK;
+}
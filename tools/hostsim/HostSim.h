@@ -0,0 +1,132 @@
+/*!
+ *  @file       HostSim.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief Virtual time and I2S DMA of the host simulation.
+ *
+ * The virtual clock runs at the host clock times the CPU scale, so code
+ * that takes 1 ms on the host takes scale ms of device time. Waits, a
+ * full DMA or delay(), move the clock forward without host time passing.
+ * The DMA plays the queued samples at the sample rate. A write that finds
+ * the queue already played out is an underrun, the DAC would have repeated
+ * old buffers for the gap. A block whose render took longer than the spike
+ * fraction of its own play time is a spike, the queue is close to running dry.
+ */
+class HostSim
+{
+public:
+    static const int UNDERRUN = 0;
+    static const int SPIKE    = 1;
+    static const int REINSTALL = 2; // I2S driver installed again, the audio stops for a moment
+
+    struct Event {
+        int type;
+        uint64_t nanos;       // virtual time of the write
+        uint64_t renderNanos; // time since the previous write returned
+        int samples;          // samples in the block
+        int gapSamples;       // samples the DAC went without new audio
+    };
+
+    struct Stats {
+        uint32_t blocks;
+        uint32_t underruns;
+        uint32_t spikes;
+        uint64_t gapSamples;
+        uint64_t totalRenderNanos;
+        uint64_t maxRenderNanos;
+        int minHeadroom;      // fewest queued samples when a write came in
+    };
+
+    void setCpuScale(double scale) { cpuScale = scale; }
+    double getCpuScale() const { return cpuScale; }
+    void setSpikePercent(int percent) { spikePercent = percent; }
+
+    // Virtual clock in nanoseconds
+    uint64_t now();
+    void pause();  // stop the clock while the simulation does its own work
+    void resume();
+    void advance(uint64_t nanos);
+
+    // DMA model, called from the I2S shim
+    void install(int nrOfBuffers, int bufferLength, int sampleRate);
+    void uninstall();
+    void write(const uint32_t *toSamples, int samples);
+
+    // Called for every block written, with the render time before the write
+    typedef void (*WriteHook)(const uint32_t *toSamples, int samples, uint64_t renderNanos);
+    void setWriteHook(WriteHook hook) { writeHook = hook; }
+
+    int getSampleRate() const { return sampleRate; }
+    const Stats &getStats() const { return stats; }
+    const std::vector<Event> &getEvents() const { return events; }
+
+    bool serialEcho = false; // print the Serial output of the synthesizer
+
+    // Heap model for heap_caps_malloc(): free regions that an allocation
+    // can not span, as the internal RAM of the ESP32. Unlimited until set.
+    void setHeapRegions(const size_t *toSizes, int nrOfRegions);
+    void *heapAlloc(size_t bytes);
+    void heapFree(void *toMemory);
+    size_t getLargestFreeBlock() const;
+
+private:
+    uint64_t hostNanos() const;
+    uint64_t samplesToNanos(double samples) const;
+
+    double cpuScale = 1.0;
+    int spikePercent = 75;
+    bool running = true;
+    uint64_t virtualBase = 0; // virtual time at hostMark
+    uint64_t hostMark = 0;
+
+    int sampleRate = 44100;
+    int capacity = 0;        // samples the DMA buffers hold
+    bool playing = false;    // DMA has been written since the install
+    double queueEnd = 0;     // sample clock position where the queued audio runs out
+    uint64_t lastReturn = 0; // virtual time the previous write returned
+    Stats stats = {};
+    WriteHook writeHook = NULL;
+    std::vector<Event> events;
+
+    struct HeapBlock {
+        void *toMemory;
+        int region;
+        size_t bytes;
+    };
+    bool heapModel = false;
+    std::vector<size_t> heapRegions;   // free bytes in each region
+    std::vector<HeapBlock> heapBlocks; // taken from the regions
+};
+
+extern HostSim hostSim;
@@ -0,0 +1,101 @@
+/*!
+ *  @file       MidiTrace.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "MidiTrace.h"
+
+// -----------------------------------------------------------------------------
+bool MidiTrace::load(const char *toName, Settings *toSettings) {
+    FILE *toFile = fopen(toName, "r");
+    if (toFile == NULL)
+      return false;
+
+    messages.clear();
+    recorded = false;
+    std::vector<double> times;
+    char line[2048];
+    int lineNr = 0;
+    while (fgets(line, sizeof(line), toFile) != NULL) {
+      lineNr++;
+      if (sscanf(line, "# polysynth voices:%d limit:%d profile:%d rate:%d", &toSettings->voices,
+            &toSettings->limit, &toSettings->profile, &toSettings->rate) == 4) {
+        recorded = true;
+        continue;
+      }
+      char *toComment = strchr(line, '#');
+      if (toComment != NULL)
+        *toComment = 0;
+      char *toNext;
+      double time = strtod(line, &toNext);
+      if ((toNext == line) || ((*toNext != ' ') && (*toNext != '\t')))
+        continue;
+      Message message;
+      char *toByte = toNext;
+      while (1) {
+        long value = strtol(toByte, &toNext, 16);
+        if (toNext == toByte)
+          break;
+        if ((value < 0) || (value > 0xff)) {
+          fprintf(stderr, "%s:%d: byte out of range\n", toName, lineNr);
+          fclose(toFile);
+          return false;
+        }
+        message.bytes.push_back((uint8_t) value);
+        toByte = toNext;
+      }
+      if (message.bytes.empty())
+        continue;
+      if ((time < 0) || (!times.empty() && (time < times.back()))) {
+        fprintf(stderr, "%s:%d: time goes back\n", toName, lineNr);
+        fclose(toFile);
+        return false;
+      }
+      times.push_back(time);
+      messages.push_back(message);
+    }
+    fclose(toFile);
+    if (recorded && (toSettings->rate <= 0)) {
+      fprintf(stderr, "%s: no sample rate in the header\n", toName);
+      return false;
+    }
+
+    // A header anywhere in the file makes it a dump, so the times are
+    // converted once the whole file is read
+    for (size_t index = 0; index < messages.size(); index++) {
+      if (recorded) {
+        messages[index].sample = (uint32_t) times[index];
+        messages[index].nanos = (uint64_t) (((times[index] - times[0]) * 1e9) / toSettings->rate);
+      } else {
+        messages[index].sample = (uint32_t) ((times[index] * toSettings->rate) / 1000);
+        messages[index].nanos = (uint64_t) (times[index] * 1e6);
+      }
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+/*!
+ *  @file       MidiTrace.h
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+// -----------------------------------------------------------------------------
+
+/*! \brief MIDI trace file of the host tools, read by rtsim and replay.
+ *
+ * A trace has one message per line, a time followed by the bytes in hex,
+ * # starts a comment. A trace written by hand or by a script has the time
+ * in milliseconds. The dump of MidiRecorder, 'd' on the Serial port, starts
+ * with a "# polysynth" header and has the sample clock of the block the
+ * message acted on. Every message gets both times: the sample clock is
+ * converted from the milliseconds at the rate of the settings, and the
+ * time of a dump is counted from its first message. Lines that do not
+ * start with a number are skipped, so a dump can be cut from a log.
+ */
+class MidiTrace
+{
+public:
+    struct Message {
+        uint64_t nanos;  // after the start of the trace
+        uint32_t sample; // sample clock of the block the message acts on
+        std::vector<uint8_t> bytes;
+    };
+
+    // Read from the header of a dump, the caller sets the defaults
+    struct Settings {
+        int voices;
+        int limit;
+        int profile;
+        int rate;
+    };
+
+    bool load(const char *toName, Settings *toSettings);
+    bool isRecorded() const { return recorded; }
+
+    std::vector<Message> messages;
+
+private:
+    bool recorded = false; // times are sample clocks
+};
+
+// -----------------------------------------------------------------------------
@@ -0,0 +1,31 @@
+// Host stand-in for the Arduino Wire library. Answers like an AC101,
+// a register file that the reset value 0x123 in register 0 clears.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+class TwoWire
+{
+public:
+    bool begin(int sda, int scl, uint32_t frequency);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t value);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint16_t address, uint8_t size, bool sendStop = true);
+    int read();
+
+private:
+    void advance(int bytes);
+
+    uint16_t registers[256] = {};
+    uint8_t transmit[64];
+    int transmitSize = 0;
+    uint8_t selected = 0; // register of the next read
+    uint8_t receive[2];
+    int receiveSize = 0;
+    int receiveIndex = 0;
+    uint32_t frequency = 400000;
+};
+
+extern TwoWire Wire;
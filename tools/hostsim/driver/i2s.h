@@ -0,0 +1,49 @@
+// Host stand-in for the ESP-IDF I2S driver, i2s_write() feeds the
+// simulated DMA of HostSim and waits on its virtual clock.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef enum { I2S_NUM_0 = 0, I2S_NUM_MAX } i2s_port_t;
+typedef int i2s_mode_t;
+typedef int i2s_comm_format_t;
+
+#define I2S_MODE_MASTER 1
+#define I2S_MODE_TX 4
+#define I2S_COMM_FORMAT_I2S 1
+#define I2S_COMM_FORMAT_I2S_MSB 2
+#define I2S_BITS_PER_SAMPLE_16BIT 16
+#define I2S_CHANNEL_FMT_RIGHT_LEFT 0
+#define ESP_INTR_FLAG_LEVEL1 2
+#define I2S_PIN_NO_CHANGE -1
+
+typedef struct {
+    int bck_io_num;
+    int ws_io_num;
+    int data_out_num;
+    int data_in_num;
+} i2s_pin_config_t;
+
+typedef struct {
+    int mode;
+    int sample_rate;
+    int bits_per_sample;
+    int channel_format;
+    int communication_format;
+    int intr_alloc_flags;
+    int dma_buf_count;
+    int dma_buf_len;
+    int use_apll;
+} i2s_config_t;
+
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t *pins);
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *config, int queueSize, void *queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t port);
+esp_err_t i2s_start(i2s_port_t port);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port);
+esp_err_t i2s_write(i2s_port_t port, const void *source, size_t size, size_t *written, uint32_t ticksToWait);
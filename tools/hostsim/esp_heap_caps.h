@@ -0,0 +1,12 @@
+// Host stand-in for the ESP-IDF heap functions. The heap is unlimited
+// until HostSim::setHeapRegions() models the internal RAM of the ESP32.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void *toMemory);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
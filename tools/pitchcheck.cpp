@@ -0,0 +1,143 @@
+/*!
+ *  @file       pitchcheck.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Pitch range check of the wave generators, runs on Linux without the ESP32.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -Isrc -o pitchcheck tools/pitchcheck.cpp tools/hostsim/HostSim.cpp $(ls src/*.cpp | grep -v main.cpp)
+//   ./pitchcheck
+//
+// Sets a channel to the largest pitch MIDI can ask for, bend range 127,
+// coarse tune +63, full bend up and full vibrato, and to the lowest, and
+// plays every note and style with the resulting increments, gliding from
+// one extreme to the other every block, and once more with increments far
+// beyond any pitch. The wave generators play a table of zeros between guard
+// samples at full scale, so any sample that is not zero was read outside
+// the table. A read far outside crashes the check instead. Exits with 1
+// when the pitch settings are not limited or a sample was read outside.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <Arduino.h>
+#include "MidiChannel.h"
+#include "WaveFactory.h"
+#include "WaveGenerator.h"
+#include "constants.h"
+
+static const int GUARDSAMPLES = 4096;
+static const uint32_t GUARDSAMPLE = 0x7fff7fff;
+static const int NROFBLOCKS = 64;
+
+static void setRpn(MidiChannel *toChannel, uint16_t rpn, uint8_t value) {
+  toChannel->controlChange(MidiChannel::CCRPNMSB, rpn >> 7);
+  toChannel->controlChange(MidiChannel::CCRPNLSB, rpn & 0x7f);
+  toChannel->controlChange(MidiChannel::CCDATAENTRY, value);
+}
+
+// Channel at an extreme of the pitch range
+static void setExtreme(MidiChannel *toChannel, bool up, float lfo) {
+  toChannel->begin(0);
+  setRpn(toChannel, MidiChannel::RPNBENDRANGE, 127);
+  setRpn(toChannel, MidiChannel::RPNCOARSETUNE, up ? 127 : 0);
+  toChannel->controlChange(MidiChannel::CCMODULATION, 127);
+  toChannel->pitchBendChange(up ? 8191 : -8192);
+  toChannel->updatePitchFactor(lfo);
+}
+
+int main() {
+  static Arena arena;
+  static WaveFactory waveFactory;
+  if (!arena.begin(WaveFactory::arenaBytes()) || !waveFactory.begin(&arena)) {
+    fprintf(stderr, "No memory for the wave tables\n");
+    return 2;
+  }
+
+  MidiChannel high, low;
+  setExtreme(&high, true, 1.0f);
+  setExtreme(&low, false, -1.0f);
+  printf("bend range %d, coarse tune %d..%d, pitch factor %.4f..%.1f\n",
+    high.bendRange, low.coarseTune, high.coarseTune, low.pitchFactor / 65536.0, high.pitchFactor / 65536.0);
+  if ((high.bendRange != MidiChannel::MAXBENDRANGE) || (high.coarseTune != MidiChannel::MAXCOARSETUNE) ||
+      (low.coarseTune != -MidiChannel::MAXCOARSETUNE) || (low.pitchFactor <= 0) || (high.pitchFactor <= 0)) {
+    printf("FAIL pitch settings out of range\n");
+    return 1;
+  }
+
+  // Increments from the channel at both extremes, then ones no channel gives
+  static const int NROFCASES = 2;
+  static const char *CASENAMES[NROFCASES] = { "pitch range", "any increment" };
+  int failed = 0;
+
+  for (int style = 0; style < NROFSTYLES; style++) {
+    for (int noteNr = MINMIDINOTES; noteNr <= MAXMIDINOTES; noteNr++) {
+      Note *toNote = waveFactory.getNote(noteNr);
+      int size = toNote->sampleSizes[style];
+      uint32_t *toTable = (uint32_t *) malloc((size + 2 * GUARDSAMPLES) * sizeof(uint32_t));
+      for (int index = 0; index < size + 2 * GUARDSAMPLES; index++) {
+        toTable[index] = GUARDSAMPLE;
+      }
+      memset(toTable + GUARDSAMPLES, 0, size * sizeof(uint32_t));
+
+      for (int testCase = 0; testCase < NROFCASES; testCase++) {
+        int32_t highIncrement = high.pitchIncrement(toNote->phaseIncrement);
+        int32_t lowIncrement = low.pitchIncrement(toNote->phaseIncrement);
+        if (testCase == 1) {
+          highIncrement = INT32_MAX;
+          lowIncrement = INT32_MIN;
+        }
+        WaveGenerator generator;
+        generator.setWave(toTable + GUARDSAMPLES, size, highIncrement);
+        generator.setGain(UNITYGAIN);
+        int outside = 0;
+        for (int block = 0; block < NROFBLOCKS; block++) {
+          int32_t mix[BUFFERSIZE] = {};
+          generator.setTargetIncrement((block & 1) ? highIncrement : lowIncrement);
+          generator.addSamplesToMix(mix, BUFFERSIZE);
+          for (int index = 0; index < BUFFERSIZE; index++) {
+            if (mix[index] != 0)
+              outside++;
+          }
+        }
+        if (outside > 0) {
+          printf("FAIL %s, style %d note %d: %d samples read outside the table\n",
+            CASENAMES[testCase], style, noteNr, outside);
+          failed++;
+        }
+      }
+      free(toTable);
+    }
+  }
+
+  if (failed > 0) {
+    printf("%d checks failed\n", failed);
+    return 1;
+  }
+  printf("all notes stay inside their tables\n");
+  return 0;
+}
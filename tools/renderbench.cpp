@@ -0,0 +1,164 @@
+/*!
+ *  @file       renderbench.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Host check of the parallel voice render, runs on Linux without the ESP32.
+//
+//   g++ -O2 -pthread -Iinclude tools/renderbench.cpp src/ParallelRender.cpp src/Arena.cpp src/VoiceFilter.cpp -o renderbench
+//   ./renderbench [-a] [voices, default 32]
+//
+// Renders the same blocks with 1 to 8 workers. Every run must give the
+// same mix, bit for bit, as the single worker run. Reports the time per
+// block and the speedup, the host cores limit the scaling. A block uses no
+// more workers than the host has cores, each run prints how many rendered
+// at most. -a lifts that limit and the minimum of voices per worker, so on
+// a host with few cores the voices are still split over all workers and the
+// determinism check covers them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#include "ParallelRender.h"
+#include "VoiceFilter.h"
+
+static const int BLOCKSIZE = 256;
+static const int MAXVOICES = 64;
+static const int NROFBLOCKS = 4000;
+
+// Stand-in for a wave generator: a square and a saw, every other voice filtered
+struct Voice {
+  uint32_t phase;
+  uint32_t increment;
+  int32_t gain;
+  VoiceFilter filter;
+};
+
+static Voice voices[MAXVOICES];
+static FilterTables tables;
+
+static void renderVoice(void *toContext, int item, int32_t mix[], int32_t scratch[], int bufferSize) {
+  Voice *toVoice = &((Voice *) toContext)[item];
+  int32_t *toOut = toVoice->filter.isEnabled() ? scratch : mix;
+  if (toOut == scratch)
+    memset(scratch, 0, bufferSize * sizeof(int32_t));
+  for(int index = 0; index < bufferSize; index++) {
+    toVoice->phase += toVoice->increment;
+    int32_t saw = (int32_t) (toVoice->phase >> 17) - 0x4000;
+    int32_t square = (toVoice->phase & 0x80000000) ? 0x2000 : -0x2000;
+    toOut[index] += ((saw + square) * toVoice->gain) >> 15;
+  }
+  if (toOut == scratch)
+    toVoice->filter.process(scratch, mix, bufferSize);
+}
+
+static void resetVoices(int nrOfVoices) {
+  for(int voice = 0; voice < nrOfVoices; voice++) {
+    voices[voice].phase = voice * 0x01234567u;
+    voices[voice].increment = 0x00400000u + voice * 0x00031337u;
+    voices[voice].gain = 0x1000 + voice * 97;
+    voices[voice].filter.reset();
+    voices[voice].filter.setEnabled((voice & 1) != 0);
+    voices[voice].filter.setCoefficients(tables.getFrequency((50 + voice) << 8), tables.getDamping(90));
+  }
+}
+
+// Renders NROFBLOCKS, keeps the last mix and a hash of all mixes
+static double run(int nrOfWorkers, int nrOfVoices, bool allWorkers, uint64_t *toHash, int *toRan) {
+  ParallelRender render;
+  Arena arena;
+  arena.begin(ParallelRender::arenaBytes(nrOfWorkers, BLOCKSIZE));
+  if (!render.begin(nrOfWorkers, BLOCKSIZE, renderVoice, voices, &arena)) {
+    printf("  could not start %d workers\n", nrOfWorkers);
+    exit(1);
+  }
+  if (allWorkers) {
+    render.setMaxActiveWorkers(nrOfWorkers);
+    render.setMinItemsPerWorker(1);
+  }
+  resetVoices(nrOfVoices);
+  int ran = 1;
+  int items[MAXVOICES];
+  int32_t mix[BLOCKSIZE];
+  uint64_t hash = 14695981039346656037ULL;
+
+  auto start = std::chrono::steady_clock::now();
+  for(int block = 0; block < NROFBLOCKS; block++) {
+    // A changing set of voices, as notes start and stop
+    int nrOfItems = 0;
+    for(int voice = 0; voice < nrOfVoices; voice++) {
+      if (((voice * 7 + block / 50) % 11) != 0)
+        items[nrOfItems++] = voice;
+    }
+    memset(mix, 0, sizeof(mix));
+    render.render(items, nrOfItems, mix, BLOCKSIZE);
+    if (render.getActiveWorkers() > ran)
+      ran = render.getActiveWorkers();
+    for(int index = 0; index < BLOCKSIZE; index++) {
+      hash = (hash ^ (uint32_t) mix[index]) * 1099511628211ULL;
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  render.end();
+  *toHash = hash;
+  *toRan = ran;
+  return std::chrono::duration<double>(stop - start).count() * 1e6 / NROFBLOCKS;
+}
+
+int main(int argc, char *argv[]) {
+  bool allWorkers = (argc > 1) && (strcmp(argv[1], "-a") == 0);
+  if (allWorkers) {
+    argc--;
+    argv++;
+  }
+  int nrOfVoices = (argc > 1) ? atoi(argv[1]) : 32;
+  if ((nrOfVoices < 1) || (nrOfVoices > MAXVOICES))
+    nrOfVoices = 32;
+  tables.begin(48000);
+
+  uint64_t reference;
+  int ran;
+  double single = run(1, nrOfVoices, allWorkers, &reference, &ran);
+  printf("%d voices, %d blocks of %d samples, %u cores, ",
+    nrOfVoices, NROFBLOCKS, BLOCKSIZE, std::thread::hardware_concurrency());
+  if (allWorkers)
+    printf("all workers render\n");
+  else
+    printf("workers limited to the cores and %d voices each\n", ParallelRender::MINITEMSPERWORKER);
+  printf("  1 worker  (1 ran): %7.2f us per block\n", single);
+  bool identical = true;
+  for(int workers = 2; workers <= ParallelRender::MAXWORKERS; workers++) {
+    uint64_t hash;
+    double micros = run(workers, nrOfVoices, allWorkers, &hash, &ran);
+    bool same = (hash == reference);
+    identical = identical && same;
+    printf("  %d workers (%d ran): %7.2f us per block, speedup %.2f, output %s\n",
+      workers, ran, micros, single / micros, same ? "identical" : "DIFFERS");
+  }
+  return identical ? 0 : 1;
+}
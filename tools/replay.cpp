@@ -0,0 +1,312 @@
+/*!
+ *  @file       replay.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Replays a MIDI trace recorded on the device, on a Linux host.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -Isrc -o replay tools/replay.cpp tools/hostsim/HostSim.cpp tools/hostsim/MidiTrace.cpp $(ls src/*.cpp | grep -v main.cpp)
+//   ./replay [options] trace.txt
+//
+// Send 'd' to the Serial port of the synthesizer and save what it prints,
+// that is the trace: a header with the voices, voice limit and output
+// profile, then one message per line, the sample clock of the block it
+// acted on followed by the bytes in hex. Every message goes through the
+// MIDI parser and reaches PolySynth just before the block it reached on the
+// device, so the replay renders the same audio, the checksum of the output
+// shows it. The render time of every block is measured, the worst blocks
+// are listed with the messages that came in before them. A trace with the
+// time in milliseconds, as rtsim plays, is replayed too, each message
+// before the block its time falls in.
+//
+// The audio is only the same as on the device when the block size and the
+// voice limit did not follow the load there: a fixed block size, a fixed
+// voice limit or one that never dropped, and the governor at full quality.
+// The MIDI clock tempo is measured in time, not samples, and differs too.
+//
+// Options:
+//   -s scale     CPU scale, device time per host time (default 1)
+//   -n voices    override the voices of the trace
+//   -l limit     override the voice limit, 0 follows the CPU
+//   -p profile   override the output profile 0..3
+//   -w blocks    worst blocks to list (default 10)
+//   -c file      write the render time of every block as CSV
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+
+#include <Arduino.h>
+#include <MIDI.h>
+#include "PolySynth.h"
+#include "HostSim.h"
+#include "MidiTrace.h"
+
+// MIDI input port, gives the bytes of the messages for the next block
+class ReplaySerial
+{
+public:
+    void begin(long baud) {}
+    int available();
+    int read();
+    size_t write(uint8_t value) { return 1; }
+
+    std::vector<MidiTrace::Message> messages;
+    size_t next = 0;       // message being read
+    size_t nextByte = 0;
+    uint32_t sampleClock = 0;
+};
+
+int ReplaySerial::available() {
+    if ((next >= messages.size()) || (messages[next].sample > sampleClock))
+      return 0;
+    return (int) (messages[next].bytes.size() - nextByte);
+}
+
+int ReplaySerial::read() {
+    if (available() == 0)
+      return -1;
+    int value = messages[next].bytes[nextByte++];
+    if (nextByte == messages[next].bytes.size()) {
+      next++;
+      nextByte = 0;
+    }
+    return value;
+}
+
+struct ReplayMidiSettings : public midi::DefaultSettings
+{
+    static const unsigned SysExMaxSize = 256;
+};
+
+static ReplaySerial replaySerial;
+MIDI_CREATE_CUSTOM_INSTANCE(ReplaySerial, replaySerial, MIDI, ReplayMidiSettings);
+
+static PolySynth polysynth;
+
+// Handlers as in main.cpp
+static void handleNoteOn(byte channel, byte pitch, byte velocity) {
+    polysynth.setMidiTimes(MIDI.getByteMicros(), MIDI.getParseMicros());
+    polysynth.startNote(channel, pitch, velocity);
+}
+
+static uint32_t timestampMicros() {
+    return micros() | 1;
+}
+
+static void handleNoteOff(byte channel, byte pitch, byte velocity) {
+    polysynth.stopNote(channel, pitch, velocity);
+}
+
+static void handleControlChange(byte channel, byte number, byte value) {
+    polysynth.controlChange(channel, number, value);
+}
+
+static void handlePitchBend(byte channel, int bend) {
+    polysynth.pitchBend(channel, bend);
+}
+
+static void handleProgramChange(byte channel, byte number) {
+    polysynth.programChange(channel, number);
+}
+
+static void handleSystemExclusive(byte *array, unsigned size) {
+    polysynth.systemExclusive(array, size);
+}
+
+static void handleClock() {
+    polysynth.midiClock();
+}
+
+// -----------------------------------------------------------------------------
+
+struct Block {
+    uint32_t sample;      // sample clock when the block was rendered
+    uint64_t renderNanos;
+    int samples;
+    int messages;         // messages delivered before the block
+};
+
+static std::vector<Block> blocks;
+static uint32_t blockSample = 0;
+static int blockMessages = 0;
+static uint32_t checksum = 2166136261u; // FNV-1a of the output
+
+static void blockWritten(const uint32_t *toSamples, int samples, uint64_t renderNanos) {
+    for (int index = 0; index < samples; index++) {
+      uint32_t sample = toSamples[index];
+      for (int part = 0; part < 4; part++) {
+        checksum = (checksum ^ (sample & 0xff)) * 16777619u;
+        sample >>= 8;
+      }
+    }
+    Block block = { blockSample, renderNanos, samples, blockMessages };
+    blocks.push_back(block);
+}
+
+static bool loadTrace(const char *toName, MidiTrace::Settings *toSettings) {
+    MidiTrace trace;
+    if (!trace.load(toName, toSettings))
+      return false;
+    replaySerial.messages = trace.messages;
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: replay [-s scale] [-n voices] [-l limit] [-p profile] [-w blocks] [-c file] trace\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double scale = 1;
+    int voices = -1;
+    int limit = -1;
+    int profile = -1;
+    int worst = 10;
+    const char *toCsvName = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "s:n:l:p:w:c:")) != -1) {
+      switch (option) {
+        case 's': scale = atof(optarg); break;
+        case 'n': voices = atoi(optarg); break;
+        case 'l': limit = atoi(optarg); break;
+        case 'p': profile = atoi(optarg); break;
+        case 'w': worst = atoi(optarg); break;
+        case 'c': toCsvName = optarg; break;
+        default: usage();
+      }
+    }
+    if ((optind != argc - 1) || (scale <= 0))
+      usage();
+
+    MidiTrace::Settings settings = { NROFWAVEGENERATORS, PolySynth::AUTOVOICELIMIT, PolySynth::SAFEPROFILE, SAMPLERATE };
+    if (!loadTrace(argv[optind], &settings)) {
+      fprintf(stderr, "replay: cannot read %s\n", argv[optind]);
+      return 1;
+    }
+    if (voices >= 0)
+      settings.voices = voices;
+    if (limit >= 0)
+      settings.limit = limit;
+    if (profile >= 0)
+      settings.profile = profile;
+    if ((settings.profile < 0) || (settings.profile >= PolySynth::CUSTOMPROFILE))
+      usage();
+    if (settings.rate != SAMPLERATE)
+      fprintf(stderr, "replay: trace recorded at %d Hz, this build runs at %d Hz\n", settings.rate, SAMPLERATE);
+
+    hostSim.setCpuScale(scale);
+    hostSim.setWriteHook(blockWritten);
+
+    MIDI.setHandleNoteOn(handleNoteOn);
+    MIDI.setHandleNoteOff(handleNoteOff);
+    MIDI.setHandleProgramChange(handleProgramChange);
+    MIDI.setHandleControlChange(handleControlChange);
+    MIDI.setHandlePitchBend(handlePitchBend);
+    MIDI.setHandleSystemExclusive(handleSystemExclusive);
+    MIDI.setHandleClock(handleClock);
+    MIDI.setTimestampClock(timestampMicros);
+    MIDI.begin(MIDI_CHANNEL_OMNI);
+
+    polysynth.begin(settings.voices, 1, 0);
+    if (settings.limit != PolySynth::AUTOVOICELIMIT)
+      polysynth.setVoiceLimit(settings.limit);
+    if (settings.profile != PolySynth::SAFEPROFILE)
+      polysynth.setOutputProfile(settings.profile);
+    polysynth.setVolume(40);
+
+    // A trace cut from a long run starts with its first message
+    const std::vector<MidiTrace::Message> &messages = replaySerial.messages;
+    uint32_t firstSample = messages.empty() ? 0 : messages.front().sample;
+    uint32_t lastSample = messages.empty() ? 0 : messages.back().sample;
+    uint32_t endSample = lastSample - firstSample + SAMPLERATE; // one second for the releases
+    while (polysynth.getSampleClock() < endSample) {
+      replaySerial.sampleClock = polysynth.getSampleClock() + firstSample;
+      size_t before = replaySerial.next;
+      while (replaySerial.available() > 0) {
+        MIDI.read();
+      }
+      blockMessages = (int) (replaySerial.next - before);
+      blockSample = replaySerial.sampleClock;
+      polysynth.loop();
+    }
+    hostSim.pause();
+
+    if (toCsvName != NULL) {
+      FILE *toCsv = fopen(toCsvName, "w");
+      if (toCsv == NULL) {
+        fprintf(stderr, "replay: cannot write %s\n", toCsvName);
+        return 1;
+      }
+      fprintf(toCsv, "sample,samples,render_us,messages\n");
+      for (size_t index = 0; index < blocks.size(); index++) {
+        fprintf(toCsv, "%lu,%d,%.3f,%d\n", (unsigned long) blocks[index].sample, blocks[index].samples,
+          blocks[index].renderNanos / 1e3, blocks[index].messages);
+      }
+      fclose(toCsv);
+    }
+
+    std::vector<uint64_t> costs;
+    for (size_t index = 1; index < blocks.size(); index++) {
+      costs.push_back(blocks[index].renderNanos);
+    }
+    std::sort(costs.begin(), costs.end());
+    uint64_t total = 0;
+    for (size_t index = 0; index < costs.size(); index++) {
+      total += costs[index];
+    }
+
+    printf("Replayed %d messages, %d voices, limit %d, output profile %d, CPU scale %.1f\n",
+      (int) messages.size(), settings.voices, settings.limit, settings.profile, scale);
+    printf("Output %lu blocks, checksum %08lx\n", (unsigned long) blocks.size(), (unsigned long) checksum);
+    if (!costs.empty()) {
+      printf("Render per block avg:%.1fus p50:%.1fus p99:%.1fus max:%.1fus\n",
+        (total / costs.size()) / 1e3, costs[costs.size() / 2] / 1e3,
+        costs[(costs.size() * 99) / 100] / 1e3, costs.back() / 1e3);
+    }
+
+    // Worst blocks, the first block has no render time
+    std::vector<size_t> order;
+    for (size_t index = 1; index < blocks.size(); index++) {
+      order.push_back(index);
+    }
+    std::sort(order.begin(), order.end(), [](size_t a, size_t b) {
+      return blocks[a].renderNanos > blocks[b].renderNanos;
+    });
+    if (worst > (int) order.size())
+      worst = (int) order.size();
+    if (worst > 0)
+      printf("\nSample clock   render   block  messages before\n");
+    for (int index = 0; index < worst; index++) {
+      const Block &block = blocks[order[index]];
+      double blockMicros = (block.samples * 1e6) / SAMPLERATE;
+      printf("%12lu %7.1fus %6.1fus %3d\n", (unsigned long) block.sample,
+        block.renderNanos / 1e3, blockMicros, block.messages);
+    }
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*!
+ *  @file       reverbbench.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Host benchmark of the reverb, runs on Linux without the ESP32.
+//
+//   g++ -O2 -Iinclude tools/reverbbench.cpp src/Reverb.cpp src/Arena.cpp src/DelayLine.cpp -o reverbbench
+//   ./reverbbench [rate, default 48000] [RAM budget in bytes, default REVERBRAMBYTES]
+//
+// Reports the cycles per sample of the fixed point reverb and compares its
+// output with a float version of the same network.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVECYCLECOUNTER 1
+#endif
+
+#include "Reverb.h"
+#include "constants.h"
+
+static const int NROFSAMPLES = 480000;
+
+// Same network as Reverb::process, in float
+class FloatReverb
+{
+public:
+    void begin(const Reverb &reference) {
+      for(int line = 0; line < REVERBNROFLINES; line++) {
+        lengths[line] = reference.getLineLength(line);
+        buffers[line] = (float *) calloc(lengths[line], sizeof(float));
+        positions[line] = 0;
+        feedback[line] = reference.getFeedback(line) / 32768.0f;
+        lowpass[line] = 0;
+      }
+      for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+        diffuserLengths[diffuser] = reference.getDiffuserLength(diffuser);
+        diffuserBuffers[diffuser] = (float *) calloc(diffuserLengths[diffuser], sizeof(float));
+        diffuserPositions[diffuser] = 0;
+      }
+      coefficient = reference.getLowpassCoefficient() / 32768.0f;
+    }
+
+    void process(float input, float *toLeft, float *toRight) {
+      float sample = input / 4;
+      for(int diffuser = 0; diffuser < REVERBNROFDIFFUSERS; diffuser++) {
+        float *toOldest = &diffuserBuffers[diffuser][diffuserPositions[diffuser]];
+        float delayed = *toOldest;
+        float fed = sample + delayed * 0.5f;
+        *toOldest = fed;
+        diffuserPositions[diffuser] = (diffuserPositions[diffuser] + 1) % diffuserLengths[diffuser];
+        sample = delayed - fed * 0.5f;
+      }
+      for(int line = 0; line < REVERBNROFLINES; line++) {
+        float out = buffers[line][positions[line]];
+        lowpass[line] += (out - lowpass[line]) * coefficient;
+      }
+      float sum01 = lowpass[0] + lowpass[1];
+      float difference01 = lowpass[0] - lowpass[1];
+      float sum23 = lowpass[2] + lowpass[3];
+      float difference23 = lowpass[2] - lowpass[3];
+      float mixed[REVERBNROFLINES] = {
+        (sum01 + sum23) / 2, (difference01 + difference23) / 2,
+        (sum01 - sum23) / 2, (difference01 - difference23) / 2 };
+      for(int line = 0; line < REVERBNROFLINES; line++) {
+        buffers[line][positions[line]] = sample + mixed[line] * feedback[line];
+        positions[line] = (positions[line] + 1) % lengths[line];
+      }
+      *toLeft = (lowpass[0] + lowpass[2]) / 2;
+      *toRight = (lowpass[1] + lowpass[3]) / 2;
+    }
+
+private:
+    float *buffers[REVERBNROFLINES];
+    int lengths[REVERBNROFLINES];
+    int positions[REVERBNROFLINES];
+    float feedback[REVERBNROFLINES];
+    float lowpass[REVERBNROFLINES];
+    float *diffuserBuffers[REVERBNROFDIFFUSERS];
+    int diffuserLengths[REVERBNROFDIFFUSERS];
+    int diffuserPositions[REVERBNROFDIFFUSERS];
+    float coefficient;
+};
+
+// Decaying noise bursts with a tone, about the level of a few voices
+static int32_t *makeInput() {
+  int32_t *toInput = (int32_t *) malloc(NROFSAMPLES * sizeof(int32_t));
+  uint32_t seed = 12345;
+  for(int index = 0; index < NROFSAMPLES; index++) {
+    seed = seed * 1664525 + 1013904223;
+    float envelope = expf(-(index % 48000) / 4000.0f);
+    float noise = ((int32_t) (seed >> 16) - 32768) / 32768.0f;
+    toInput[index] = (int32_t) (8000 * envelope * noise + 3000 * sinf(index * 0.05f));
+  }
+  return toInput;
+}
+
+int main(int argc, char *argv[]) {
+  int rate = (argc > 1) ? atoi(argv[1]) : 48000;
+  size_t budget = (argc > 2) ? (size_t) atol(argv[2]) : REVERBRAMBYTES;
+
+  Arena arena;
+  arena.begin(Reverb::arenaBytes(rate, budget));
+  Reverb reverb;
+  if (!reverb.begin(&arena, rate, budget)) {
+    printf("reverb does not fit in %u bytes\n", (unsigned) arena.getSize());
+    return 1;
+  }
+  reverb.setTime(64);
+  reverb.setDamping(32);
+  printf("rate %d Hz, budget %u bytes, uses %u bytes\n", rate, (unsigned) budget, (unsigned) arena.getUsed());
+  printf("lines:");
+  for(int line = 0; line < REVERBNROFLINES; line++) {
+    printf(" %d", reverb.getLineLength(line));
+  }
+  printf(" samples, diffusers: %d %d, time %.2f s\n",
+    reverb.getDiffuserLength(0), reverb.getDiffuserLength(1), reverb.getTimeSeconds());
+
+  int32_t *toInput = makeInput();
+  int32_t *toLeft = (int32_t *) malloc(NROFSAMPLES * sizeof(int32_t));
+  int32_t *toRight = (int32_t *) malloc(NROFSAMPLES * sizeof(int32_t));
+
+  auto start = std::chrono::steady_clock::now();
+#ifdef HAVECYCLECOUNTER
+  uint64_t startCycles = __rdtsc();
+#endif
+  for(int index = 0; index < NROFSAMPLES; index++) {
+    reverb.process(toInput[index], &toLeft[index], &toRight[index]);
+  }
+#ifdef HAVECYCLECOUNTER
+  uint64_t cycles = __rdtsc() - startCycles;
+#endif
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / NROFSAMPLES;
+#ifdef HAVECYCLECOUNTER
+  printf("fixed point: %.1f ns, %.1f TSC cycles per sample\n", ns, (double) cycles / NROFSAMPLES);
+#else
+  printf("fixed point: %.1f ns per sample\n", ns);
+#endif
+
+  // Error against the float network, as a signal to error ratio
+  FloatReverb reference;
+  reference.begin(reverb);
+  double signal = 0;
+  double error = 0;
+  double maxError = 0;
+  for(int index = 0; index < NROFSAMPLES; index++) {
+    float left, right;
+    reference.process(toInput[index], &left, &right);
+    double errorLeft = toLeft[index] - left;
+    double errorRight = toRight[index] - right;
+    signal += left * left + right * right;
+    error += errorLeft * errorLeft + errorRight * errorRight;
+    maxError = fmax(maxError, fmax(fabs(errorLeft), fabs(errorRight)));
+  }
+  printf("signal rms %.1f error rms %.2f\n", sqrt(signal / (2.0 * NROFSAMPLES)), sqrt(error / (2.0 * NROFSAMPLES)));
+  printf("against float: %.1f dB signal to error, max error %.0f\n",
+    10 * log10(signal / (error + 1e-9)), maxError);
+  return 0;
+}
@@ -0,0 +1,423 @@
+/*!
+ *  @file       rtsim.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Real time simulation of the synthesizer on a Linux host.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -Isrc -o rtsim tools/rtsim.cpp tools/hostsim/HostSim.cpp tools/hostsim/MidiTrace.cpp $(ls src/*.cpp | grep -v main.cpp)
+//   ./rtsim [options] <trace file | MIDI file | chords | ramp | ccflood>
+//
+// The MIDI bytes of the trace go through the MIDI parser into PolySynth
+// like on the device, at their time stamps and no faster than 31250 baud.
+// The I2S DMA plays the written blocks at the sample rate on a virtual
+// clock. The render time is the host time times the CPU scale, so with
+// -s 10 the simulation behaves as if the ESP32 is 10 times slower than
+// the host. Calibrate it by matching the voice cost printed by printStats
+// on the device. Every underrun and every block that used more than the
+// spike percentage of its play time is listed with its time in the trace.
+//
+// Options:
+//   -s scale     CPU scale, device time per host time (default 10)
+//   -n voices    voices of polysynth.begin() (default NROFWAVEGENERATORS)
+//   -p profile   output profile 0..3 (default 2, safe)
+//   -k percent   spike threshold in percent of the block time (default 75)
+//   -t seconds   time to simulate (default the trace plus one second)
+//   -l events    events to list (default 40)
+//   -v           print the Serial output of the synthesizer
+//
+// A trace file has one MIDI message per line, the time in milliseconds
+// followed by the bytes in hex, # starts a comment:
+//   0     90 3c 64
+//   250.5 80 3c 00
+// A dump of the MIDI recorder, as read by tools/replay.cpp, plays too. Its
+// sample clocks are turned into time from the first message, and the
+// voices, voice limit and output profile of its header are used unless
+// -n or -p is given.
+// A file ending in .mid is a Standard MIDI File. It is memory mapped and
+// played by MidiFilePlayer through a second MIDI parser, as on the device.
+//
+// The tasks do not run on the host: everything renders in the loop with
+// one worker and no output pipeline, as with polysynth.begin(voices, 1, 0).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <vector>
+
+#include <Arduino.h>
+#include <MIDI.h>
+#include "PolySynth.h"
+#include "MidiFilePlayer.h"
+#include "HostSim.h"
+#include "MidiTrace.h"
+
+static const uint64_t BYTENANOS = 320000; // 10 bits at 31250 baud
+
+struct TimedByte {
+    uint64_t nanos; // arrival time after the start of the trace
+    uint8_t value;
+};
+
+// MIDI input port, a byte is available once the virtual clock passed its time
+class TraceSerial
+{
+public:
+    void begin(long baud) {}
+    int available() {
+      int count = 0;
+      uint64_t now = hostSim.now();
+      for (size_t index = next; index < bytes.size(); index++) {
+        if (startNanos + bytes[index].nanos > now)
+          break;
+        count++;
+      }
+      return count;
+    }
+    int read() {
+      if (next >= bytes.size())
+        return -1;
+      return bytes[next++].value;
+    }
+    size_t write(uint8_t value) { return 1; }
+
+    // Bytes of one message, queued behind the bytes before them on the line
+    void add(uint64_t nanos, const uint8_t *message, int size) {
+      for (int index = 0; index < size; index++) {
+        if (nanos < lineFree)
+          nanos = lineFree;
+        TimedByte timed = { nanos, message[index] };
+        bytes.push_back(timed);
+        lineFree = nanos + BYTENANOS;
+      }
+    }
+    uint64_t getEndNanos() const { return lineFree; }
+
+    std::vector<TimedByte> bytes;
+    size_t next = 0;
+    uint64_t startNanos = 0;
+
+private:
+    uint64_t lineFree = 0;
+};
+
+struct SimMidiSettings : public midi::DefaultSettings
+{
+    static const unsigned SysExMaxSize = 256;
+};
+
+static TraceSerial traceSerial;
+MIDI_CREATE_CUSTOM_INSTANCE(TraceSerial, traceSerial, MIDI, SimMidiSettings);
+
+static MidiFilePlayer filePlayer;
+MIDI_CREATE_CUSTOM_INSTANCE(MidiFilePlayer, filePlayer, MIDIFILE, SimMidiSettings);
+
+static PolySynth polysynth;
+
+// Handlers as in main.cpp
+static void handleNoteOn(byte channel, byte pitch, byte velocity) {
+    polysynth.setMidiTimes(MIDI.getByteMicros(), MIDI.getParseMicros());
+    polysynth.startNote(channel, pitch, velocity);
+}
+
+static void handleFileNoteOn(byte channel, byte pitch, byte velocity) {
+    polysynth.setMidiTimes(MIDIFILE.getByteMicros(), MIDIFILE.getParseMicros());
+    polysynth.startNote(channel, pitch, velocity);
+}
+
+static uint32_t timestampMicros() {
+    return micros() | 1;
+}
+
+static void handleNoteOff(byte channel, byte pitch, byte velocity) {
+    polysynth.stopNote(channel, pitch, velocity);
+}
+
+static void handleControlChange(byte channel, byte number, byte value) {
+    polysynth.controlChange(channel, number, value);
+}
+
+static void handlePitchBend(byte channel, int bend) {
+    polysynth.pitchBend(channel, bend);
+}
+
+static void handleProgramChange(byte channel, byte number) {
+    polysynth.programChange(channel, number);
+}
+
+static void handleSystemExclusive(byte *array, unsigned size) {
+    polysynth.systemExclusive(array, size);
+}
+
+static void handleClock() {
+    polysynth.midiClock();
+}
+
+// -----------------------------------------------------------------------------
+// Traces
+
+static void addMessage(double ms, uint8_t status, uint8_t data1, uint8_t data2) {
+    uint8_t message[3] = { status, data1, data2 };
+    traceSerial.add((uint64_t) (ms * 1e6), message, 3);
+}
+
+// Chords of 4 to 24 notes, held for 300 ms
+static void chordsTrace() {
+    double ms = 0;
+    for (int size = 4; size <= 24; size += 4) {
+      for (int note = 0; note < size; note++)
+        addMessage(ms, 0x90, (uint8_t) (36 + note * 3), 100);
+      ms += 300;
+      for (int note = 0; note < size; note++)
+        addMessage(ms, 0x80, (uint8_t) (36 + note * 3), 0);
+      ms += 200;
+    }
+}
+
+// One held note more every 50 ms on four channels, then all off
+static void rampTrace() {
+    double ms = 0;
+    for (int note = 0; note < 64; note++) {
+      addMessage(ms, (uint8_t) (0x90 | (note & 3)), (uint8_t) (30 + note), 90);
+      ms += 50;
+    }
+    for (int note = 0; note < 64; note++)
+      addMessage(ms, (uint8_t) (0x80 | (note & 3)), (uint8_t) (30 + note), 0);
+}
+
+// Eight notes with the cutoff swept as fast as the MIDI line allows
+static void ccfloodTrace() {
+    for (int note = 0; note < 8; note++)
+      addMessage(0, 0x90, (uint8_t) (48 + note * 2), 100);
+    for (int step = 0; step < 2000; step++) {
+      int sweep = step % 128;
+      addMessage(10, 0xB0, 74, (uint8_t) ((sweep < 64) ? 40 + sweep : 167 - sweep));
+    }
+    double ms = traceSerial.getEndNanos() / 1e6;
+    for (int note = 0; note < 8; note++)
+      addMessage(ms, 0x80, (uint8_t) (48 + note * 2), 0);
+}
+
+// The file stays mapped until the end of the simulation
+static bool mapMidiFile(const char *toName) {
+    int file = open(toName, O_RDONLY);
+    if (file < 0)
+      return false;
+    struct stat status;
+    if ((fstat(file, &status) != 0) || (status.st_size == 0)) {
+      close(file);
+      return false;
+    }
+    void *toData = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (toData == MAP_FAILED)
+      return false;
+    return filePlayer.open((const uint8_t *) toData, status.st_size);
+}
+
+static bool loadTrace(const char *toName, MidiTrace::Settings *toSettings) {
+    MidiTrace trace;
+    if (!trace.load(toName, toSettings))
+      return false;
+    for (size_t index = 0; index < trace.messages.size(); index++) {
+      const MidiTrace::Message &message = trace.messages[index];
+      traceSerial.add(message.nanos, message.bytes.data(), (int) message.bytes.size());
+    }
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+
+static double toMs(uint64_t nanos) {
+    return nanos / 1e6;
+}
+
+static void report(uint64_t startNanos, int maxEvents) {
+    const HostSim::Stats &stats = hostSim.getStats();
+    const std::vector<HostSim::Event> &events = hostSim.getEvents();
+
+    printf("\nTime (ms)   event\n");
+    int listed = 0;
+    for (size_t index = 0; index < events.size(); index++) {
+      const HostSim::Event &event = events[index];
+      if (listed == maxEvents) {
+        printf("...         %d more\n", (int) (events.size() - index));
+        break;
+      }
+      double at = ((int64_t) (event.nanos - startNanos)) / 1e6;
+      double blockMs = (event.samples * 1000.0) / hostSim.getSampleRate();
+      switch (event.type) {
+        case HostSim::UNDERRUN:
+          printf("%10.3f  underrun, render %.3f ms for a %.3f ms block, %d samples (%.3f ms) without audio\n",
+            at, toMs(event.renderNanos), blockMs, event.gapSamples,
+            (event.gapSamples * 1000.0) / hostSim.getSampleRate());
+          break;
+        case HostSim::SPIKE:
+          printf("%10.3f  spike, render %.3f ms for a %.3f ms block (%d%%)\n",
+            at, toMs(event.renderNanos), blockMs,
+            (int) ((event.renderNanos / 1e4) / blockMs));
+          break;
+        case HostSim::REINSTALL:
+          printf("%10.3f  I2S driver installed again\n", at);
+          break;
+      }
+      listed++;
+    }
+
+    uint64_t average = (stats.blocks > 0) ? stats.totalRenderNanos / stats.blocks : 0;
+    printf("\nBlocks:%lu render avg:%.3fms max:%.3fms, fewest samples queued:%d\n",
+      (unsigned long) stats.blocks, toMs(average), toMs(stats.maxRenderNanos), stats.minHeadroom);
+    printf("Underruns:%lu (%.3f ms without audio), spikes:%lu\n",
+      (unsigned long) stats.underruns, (stats.gapSamples * 1000.0) / hostSim.getSampleRate(),
+      (unsigned long) stats.spikes);
+}
+
+static void usage() {
+    fprintf(stderr, "usage: rtsim [-s scale] [-n voices] [-p profile] [-k percent] [-t seconds] [-l events] [-v]\n"
+      "             <trace file | MIDI file | chords | ramp | ccflood>\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    double scale = 10;
+    int voices = -1;
+    int profile = -1;
+    double seconds = 0;
+    int maxEvents = 40;
+    int option;
+    while ((option = getopt(argc, argv, "s:n:p:k:t:l:v")) != -1) {
+      switch (option) {
+        case 's': scale = atof(optarg); break;
+        case 'n': voices = atoi(optarg); break;
+        case 'p': profile = atoi(optarg); break;
+        case 'k': hostSim.setSpikePercent(atoi(optarg)); break;
+        case 't': seconds = atof(optarg); break;
+        case 'l': maxEvents = atoi(optarg); break;
+        case 'v': hostSim.serialEcho = true; break;
+        default: usage();
+      }
+    }
+    if ((optind != argc - 1) || (scale <= 0) || (profile >= PolySynth::CUSTOMPROFILE))
+      usage();
+
+    MidiTrace::Settings settings = { NROFWAVEGENERATORS, PolySynth::AUTOVOICELIMIT, PolySynth::SAFEPROFILE, SAMPLERATE };
+    const char *toTrace = argv[optind];
+    size_t nameLength = strlen(toTrace);
+    bool midiFile = (nameLength > 4) && (strcmp(&toTrace[nameLength - 4], ".mid") == 0);
+    if (midiFile) {
+      if (!mapMidiFile(toTrace)) {
+        fprintf(stderr, "rtsim: %s is not a MIDI file of type 0 or 1\n", toTrace);
+        return 1;
+      }
+    } else
+    if (strcmp(toTrace, "chords") == 0)
+      chordsTrace();
+    else if (strcmp(toTrace, "ramp") == 0)
+      rampTrace();
+    else if (strcmp(toTrace, "ccflood") == 0)
+      ccfloodTrace();
+    else if (!loadTrace(toTrace, &settings)) {
+      fprintf(stderr, "rtsim: cannot read %s\n", toTrace);
+      return 1;
+    }
+    if ((seconds <= 0) && !midiFile)
+      seconds = traceSerial.getEndNanos() / 1e9 + 1.0;
+    if (voices < 0)
+      voices = settings.voices;
+    if (profile < 0)
+      profile = settings.profile;
+
+    hostSim.setCpuScale(scale);
+
+    MIDI.setHandleNoteOn(handleNoteOn);
+    MIDI.setHandleNoteOff(handleNoteOff);
+    MIDI.setHandleProgramChange(handleProgramChange);
+    MIDI.setHandleControlChange(handleControlChange);
+    MIDI.setHandlePitchBend(handlePitchBend);
+    MIDI.setHandleSystemExclusive(handleSystemExclusive);
+    MIDI.setHandleClock(handleClock);
+    MIDI.setTimestampClock(timestampMicros);
+    MIDI.begin(MIDI_CHANNEL_OMNI);
+
+    MIDIFILE.setHandleNoteOn(handleFileNoteOn);
+    MIDIFILE.setHandleNoteOff(handleNoteOff);
+    MIDIFILE.setHandleProgramChange(handleProgramChange);
+    MIDIFILE.setHandleControlChange(handleControlChange);
+    MIDIFILE.setHandlePitchBend(handlePitchBend);
+    MIDIFILE.setHandleSystemExclusive(handleSystemExclusive);
+    MIDIFILE.setTimestampClock(timestampMicros);
+    MIDIFILE.begin(MIDI_CHANNEL_OMNI);
+
+    polysynth.begin(voices, 1, 0);
+    if (settings.limit != PolySynth::AUTOVOICELIMIT)
+      polysynth.setVoiceLimit(settings.limit);
+    if (profile != PolySynth::SAFEPROFILE)
+      polysynth.setOutputProfile(profile);
+    polysynth.setVolume(40);
+
+    // The trace starts now, after the codec init
+    uint64_t startNanos = hostSim.now();
+    traceSerial.startNanos = startNanos;
+    uint64_t endNanos = startNanos + (uint64_t) (seconds * 1e9);
+    if (midiFile)
+      filePlayer.start(micros());
+    while (1) {
+      uint64_t now = hostSim.now();
+      if (seconds > 0) {
+        if (now >= endNanos)
+          break;
+      } else
+      if (!filePlayer.isPlaying()) {
+        // A MIDI file plays to its end, then one second for the releases
+        seconds = (now - startNanos) / 1e9 + 1.0;
+        endNanos = now + 1000000000ULL;
+      }
+      MIDI.read();
+      filePlayer.update(micros());
+      while (filePlayer.available() > 0) {
+        MIDIFILE.read();
+      }
+      polysynth.loop();
+    }
+
+    hostSim.pause();
+    if (midiFile) {
+      const MidiFilePlayer::Stats &fileStats = filePlayer.getStats();
+      printf("MIDI file: %d tracks, %lu messages, %lu tempo changes, %lu errors\n",
+        filePlayer.getNrOfTracks(), (unsigned long) fileStats.events,
+        (unsigned long) fileStats.tempoChanges, (unsigned long) fileStats.errors);
+    }
+    printf("Simulated %.2f s of %s at CPU scale %.1f, %d voices, output profile %d\n",
+      seconds, toTrace, scale, voices, profile);
+    report(startNanos, maxEvents);
+    printf("\n");
+    hostSim.serialEcho = true;
+    polysynth.printStats();
+    return 0;
+}
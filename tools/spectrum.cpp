@@ -0,0 +1,237 @@
+/*!
+ *  @file       spectrum.cpp
+ *  Project     ESP32-A1S Polyphonic MIDI Synthesizer 
+  * @brief      MIDI controlled Polyphonic ESP32-A1S based synthesizer.
+ *  @author     Rob van der Ouderaa
+ *  @date       27/02/2020
+ *  @license    MIT - Copyright (c) 2020 Rob van der Ouderaa
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// Spectral quality of the wave tables, runs on Linux without the ESP32.
+//
+//   g++ -O2 -DARDUINO -Itools/hostsim -Iinclude -o spectrum tools/spectrum.cpp tools/hostsim/HostSim.cpp src/WaveFactory.cpp src/WaveGenerator.cpp src/VoiceFilter.cpp src/Arena.cpp
+//   ./spectrum [-s style 0..2] [-f first note] [-l last note] [-n log2 FFT size, default 18]
+//
+// Renders every MIDI note 21..127 of every style with WaveGenerator and the
+// tables of WaveFactory, as a voice plays them, and reports per note:
+//   cents  pitch error of the output against equal temperament, A4 = 440 Hz,
+//          from the zero crossings of the whole render
+//   thd    power of harmonics 2 and up below Nyquist against the fundamental,
+//          only the sinus should be low, triangle and square are made of them
+//   alias  power outside the harmonics of the note against the fundamental,
+//          partials folded back from above Nyquist and table noise
+// The spectrum uses a 4 term Blackman-Harris window, a harmonic owns the
+// bins within HARMONICBINS of its frequency. A summary per style follows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <complex>
+#include <vector>
+
+#include <Arduino.h>
+#include "WaveFactory.h"
+#include "WaveGenerator.h"
+
+static const double HARMONICBINS = 6.0; // main lobe of the window and some leakage
+static const char *STYLENAMES[] = { "sinus", "triangle", "square" };
+
+static WaveFactory waveFactory;
+static Arena arena;
+
+// In place radix 2 FFT, size is a power of 2
+static void fft(std::vector<std::complex<double>> &data) {
+    size_t size = data.size();
+    for (size_t index = 1, reversed = 0; index < size; index++) {
+      size_t bit = size >> 1;
+      for (; reversed & bit; bit >>= 1)
+        reversed ^= bit;
+      reversed ^= bit;
+      if (index < reversed)
+        std::swap(data[index], data[reversed]);
+    }
+    for (size_t length = 2; length <= size; length <<= 1) {
+      double angle = -2.0 * M_PI / length;
+      std::complex<double> step(cos(angle), sin(angle));
+      for (size_t start = 0; start < size; start += length) {
+        std::complex<double> twiddle(1.0, 0.0);
+        for (size_t index = 0; index < length / 2; index++) {
+          std::complex<double> even = data[start + index];
+          std::complex<double> odd = data[start + index + length / 2] * twiddle;
+          data[start + index] = even + odd;
+          data[start + index + length / 2] = even - odd;
+          twiddle *= step;
+        }
+      }
+    }
+}
+
+// Output of one voice at unity gain, as PolySynth renders it block by block
+static void renderNote(int style, int noteNr, std::vector<double> &output) {
+    Note *toNote = waveFactory.getNote(noteNr);
+    WaveGenerator generator;
+    generator.setWave(toNote->samples[style], toNote->sampleSizes[style], toNote->phaseIncrement);
+    generator.setGain(UNITYGAIN);
+    int32_t mix[BUFFERSIZE];
+    for (size_t done = 0; done < output.size(); done += BUFFERSIZE) {
+      memset(mix, 0, sizeof(mix));
+      generator.addSamplesToMix(mix, BUFFERSIZE);
+      for (int index = 0; (index < BUFFERSIZE) && (done + index < output.size()); index++) {
+        output[done + index] = mix[index];
+      }
+    }
+}
+
+// Frequency from the first and last rising zero crossing, interpolated
+// between the samples around them
+static double measureFrequency(const std::vector<double> &output) {
+    double first = -1;
+    double last = -1;
+    int crossings = 0;
+    for (size_t index = 1; index < output.size(); index++) {
+      if ((output[index - 1] < 0) && (output[index] >= 0)) {
+        double at = (index - 1) + (-output[index - 1]) / (output[index] - output[index - 1]);
+        if (first < 0)
+          first = at;
+        last = at;
+        crossings++;
+      }
+    }
+    if (crossings < 2)
+      return 0;
+    return ((crossings - 1) * (double) SAMPLERATE) / (last - first);
+}
+
+struct Quality {
+    double targetHz;
+    double measuredHz;
+    double cents;
+    double thdDb;
+    double aliasDb;
+};
+
+static Quality analyse(int style, int noteNr, int fftBits) {
+    size_t size = (size_t) 1 << fftBits;
+    std::vector<double> output(size);
+    renderNote(style, noteNr, output);
+
+    Quality quality;
+    quality.targetHz = 440.0 * pow(2.0, (noteNr - 69) / 12.0);
+    quality.measuredHz = measureFrequency(output);
+    quality.cents = (quality.measuredHz > 0) ? 1200.0 * log2(quality.measuredHz / quality.targetHz) : 0;
+
+    std::vector<std::complex<double>> spectrum(size);
+    for (size_t index = 0; index < size; index++) {
+      double x = (2.0 * M_PI * index) / size;
+      double window = 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+      spectrum[index] = output[index] * window;
+    }
+    fft(spectrum);
+
+    // Power per harmonic of the measured fundamental, the rest is alias
+    double binHz = (double) SAMPLERATE / size;
+    double f0 = (quality.measuredHz > 0) ? quality.measuredHz : quality.targetHz;
+    int nrOfHarmonics = (int) ((SAMPLERATE / 2) / f0);
+    std::vector<double> harmonics(nrOfHarmonics + 1, 0.0);
+    double alias = 0;
+    for (size_t bin = 1; bin < size / 2; bin++) {
+      double power = std::norm(spectrum[bin]);
+      double harmonic = (bin * binHz) / f0;
+      int nearest = (int) (harmonic + 0.5);
+      if ((nearest >= 1) && (nearest <= nrOfHarmonics) &&
+          (fabs(bin - nearest * f0 / binHz) <= HARMONICBINS))
+        harmonics[nearest] += power;
+      else if (bin > HARMONICBINS) // leave DC to the window
+        alias += power;
+    }
+    double distortion = 0;
+    for (int harmonic = 2; harmonic <= nrOfHarmonics; harmonic++) {
+      distortion += harmonics[harmonic];
+    }
+    double fundamental = (harmonics.size() > 1) ? harmonics[1] : 0;
+    if (fundamental <= 0)
+      fundamental = 1e-30;
+    quality.thdDb = 10.0 * log10((distortion + 1e-30) / fundamental);
+    quality.aliasDb = 10.0 * log10((alias + 1e-30) / fundamental);
+    return quality;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: spectrum [-s style 0..2] [-f first note] [-l last note] [-n log2 FFT size]\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    int firstStyle = 0;
+    int lastStyle = NROFSTYLES - 1;
+    int firstNote = MINMIDINOTES;
+    int lastNote = MAXMIDINOTES;
+    int fftBits = 18;
+    int option;
+    while ((option = getopt(argc, argv, "s:f:l:n:")) != -1) {
+      switch (option) {
+        case 's': firstStyle = lastStyle = atoi(optarg); break;
+        case 'f': firstNote = atoi(optarg); break;
+        case 'l': lastNote = atoi(optarg); break;
+        case 'n': fftBits = atoi(optarg); break;
+        default: usage();
+      }
+    }
+    if ((firstStyle < 0) || (lastStyle >= NROFSTYLES) || (firstNote < MINMIDINOTES) ||
+        (lastNote > MAXMIDINOTES) || (firstNote > lastNote) || (fftBits < 12) || (fftBits > 22))
+      usage();
+
+    if (!arena.begin(WaveFactory::arenaBytes()) || !waveFactory.begin(&arena)) {
+      fprintf(stderr, "No memory for the wave tables\n");
+      return 1;
+    }
+    printf("Sample rate %d Hz, FFT of %d samples (%.2f Hz per bin)\n\n",
+      SAMPLERATE, 1 << fftBits, (double) SAMPLERATE / (1 << fftBits));
+    printf("style    note     nr   target Hz  measured Hz    cents   thd dB  alias dB\n");
+
+    for (int style = firstStyle; style <= lastStyle; style++) {
+      double worstCents = 0;
+      int worstCentsNote = firstNote;
+      double worstAlias = -400;
+      int worstAliasNote = firstNote;
+      double totalAbsCents = 0;
+      for (int noteNr = firstNote; noteNr <= lastNote; noteNr++) {
+        Quality quality = analyse(style, noteNr, fftBits);
+        printf("%-8s %-5s %4d %11.3f %12.3f %8.3f %8.1f %9.1f\n", STYLENAMES[style],
+          waveFactory.getNote(noteNr)->name, noteNr, quality.targetHz, quality.measuredHz,
+          quality.cents, quality.thdDb, quality.aliasDb);
+        totalAbsCents += fabs(quality.cents);
+        if (fabs(quality.cents) > fabs(worstCents)) {
+          worstCents = quality.cents;
+          worstCentsNote = noteNr;
+        }
+        if (quality.aliasDb > worstAlias) {
+          worstAlias = quality.aliasDb;
+          worstAliasNote = noteNr;
+        }
+      }
+      printf("%-8s mean |cents|:%.3f worst:%.3f at %d, worst alias:%.1f dB at %d\n\n", STYLENAMES[style],
+        totalAbsCents / (lastNote - firstNote + 1), worstCents, worstCentsNote, worstAlias, worstAliasNote);
+    }
+    return 0;
+}